@@ -19,6 +19,12 @@
 #pragma once
 
 #include <iostream>
+#include <limits>
+#include <atomic>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#endif
 #include <argparse/argparse.hpp>
 #include "bench_utils.hpp"
 
@@ -40,20 +46,217 @@ auto test_out = TestOutput();
 auto test_verbose = true;
 bool print_csv = false;
 std::string csv_file = "";
+uint64_t latency_sample = 0; /* times one query every 'latency_sample' queries, 0 to disable */
+int query_threads = 1; /* the number of threads of the throughput test */
+bool concurrent_queries = false; /* true if the benchmarked filter supports concurrent queries, see init_parser */
+std::string save_file, load_file; /* see save_load_filter */
+bool drop_cache = false;
 
-template <typename InitFun, typename RangeFun, typename SizeFun, typename key_type, typename... Args>
-void experiment(InitFun init_f, RangeFun range_f, SizeFun size_f, const double param, InputKeys<key_type> &keys, Workload<key_type> &queries, Args... args)
+/**
+ * Returns the overhead of a pair of clock readings, i.e. the minimum of a number of empty timings.
+ */
+uint64_t clock_overhead_ns()
+{
+    auto overhead = std::numeric_limits<int64_t>::max();
+    for (auto i = 0; i < 1000; i++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        auto t1 = std::chrono::steady_clock::now();
+        overhead = std::min<int64_t>(overhead, std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    }
+    return overhead;
+}
+
+/**
+ * Pins the calling thread to the CPU 'cpu' (modulo the number of CPUs), if supported by the platform.
+ */
+void pin_thread(const int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % std::max(1U, std::thread::hardware_concurrency()), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+/**
+ * Runs the queries on 'n_threads' threads sharing the filter 'f'. The workload is split into contiguous parts, one
+ * for each thread, and the threads are pinned to distinct CPUs and released together by a start barrier. Reports the
+ * aggregate throughput, the average latency of each thread (separated by ';') and of the slowest and fastest thread.
+ */
+template <typename FilterType, typename RangeFun, typename QueriesType>
+void throughput_experiment(FilterType &f, RangeFun range_f, const QueriesType &queries, const int n_threads)
+{
+    std::vector<std::thread> workers;
+    std::vector<double> thread_ns(n_threads, 0);
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::atomic<size_t> positives(0);
+    const auto n = queries.size();
+
+    for (auto t = 0; t < n_threads; t++)
+        workers.emplace_back([&, t] {
+            pin_thread(t);
+            const auto begin = queries.begin() + (t * n) / n_threads, end = queries.begin() + ((t + 1) * n) / n_threads;
+            ready++;
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+
+            size_t local_positives = 0;
+            auto t0 = std::chrono::steady_clock::now();
+            for (auto it = begin; it != end; ++it)
+                local_positives += range_f(f, std::get<0>(*it), std::get<1>(*it));
+            auto t1 = std::chrono::steady_clock::now();
+
+            thread_ns[t] = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / std::max<size_t>(1, end - begin);
+            positives += local_positives;
+        });
+
+    while (ready.load() < n_threads)
+        std::this_thread::yield();
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto &w : workers)
+        w.join();
+    auto elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    auto mqps = (double) n / elapsed_ns * 1000;
+    std::cout << "[+] " << n_threads << " threads: " << mqps << " Mqueries/s (" << positives << " positives)" << std::endl;
+    std::string per_thread;
+    for (auto t = 0; t < n_threads; t++)
+    {
+        std::cout << "[+] thread " << t << ": " << thread_ns[t] << " ns/query" << std::endl;
+        per_thread += (t > 0 ? ";" : "") + std::to_string(thread_ns[t]);
+    }
+    test_out.add_measure("mt_mqueries_per_sec", mqps);
+    test_out.add_measure("mt_thread_ns_per_query", per_thread);
+    test_out.add_measure("mt_thread_ns_per_query_min", *std::min_element(thread_ns.begin(), thread_ns.end()));
+    test_out.add_measure("mt_thread_ns_per_query_max", *std::max_element(thread_ns.begin(), thread_ns.end()));
+}
+
+/**
+ * Serializes the filter to 'save_file', or replaces the empty filter returned by the init function (see
+ * skip_build_for_load) with the filter deserialized from 'load_file', if they are set. It runs after the build
+ * measures are taken (see experiment_after_build). The load file must have been saved with the same options. If
+ * 'drop_cache' is set, the pages of the file are evicted from the page cache before the load, so that it is measured
+ * from the disk (a cold restart). The time to the first query after the load is measured on the first input key.
+ *
+ * The measures of the unused modes are reported as "nan".
+ */
+template <typename FilterType, typename t_itr>
+void save_load_filter(FilterType &filter, const t_itr begin)
+{
+    auto add_measure = [](const std::string &name, const double value)
+    {
+        if (std::isnan(value))
+            test_out.add_measure(name, std::string("nan"));
+        else
+            test_out.add_measure(name, value);
+    };
+    auto elapsed_ms = [](auto start) { return std::chrono::duration<double, std::milli>(timer::now() - start).count(); };
+
+    double save_ms = NAN, save_mb = NAN, load_ms = NAN, load_mb = NAN, first_query_ns = NAN;
+    bool cold_load = false;
+    if (!save_file.empty())
+    {
+        auto start = timer::now();
+        std::ofstream out(save_file, std::ios::binary | std::ios::trunc);
+        out << filter;
+        out.close();
+        save_ms = elapsed_ms(start);
+        if (!out)
+            throw std::runtime_error("error, cannot save the filter to " + save_file);
+        save_mb = TO_MB(std::filesystem::file_size(save_file));
+    }
+
+    if (!load_file.empty())
+    {
+        cold_load = drop_cache && drop_file_cache(load_file);
+
+        auto start = timer::now();
+        std::ifstream in(load_file, std::ios::binary);
+        in >> filter;
+        load_ms = elapsed_ms(start);
+        if (!in)
+            throw std::runtime_error("error, cannot load the filter from " + load_file);
+        load_mb = TO_MB(std::filesystem::file_size(load_file));
+
+        start = timer::now();
+        volatile bool res = filter.query(*begin, *begin);
+        first_query_ns = elapsed_ms(start) * 1e6;
+        if (!res)
+            throw std::runtime_error("error, the loaded filter does not match the input keys");
+    }
+
+    add_measure("save_ms", save_ms);
+    add_measure("save_mb_per_sec", save_mb / (save_ms / 1000));
+    add_measure("load_ms", load_ms);
+    add_measure("load_mb_per_sec", load_mb / (load_ms / 1000));
+    add_measure("file_mb", std::isnan(save_mb) ? load_mb : save_mb);
+    add_measure("first_query_ns", first_query_ns);
+    test_out.add_measure("cold_load", cold_load);
+}
+
+/**
+ * Returns true if the filter is loaded from 'load_file' rather than built, in which case the build measures are
+ * reported as "nan" and the init function returns an empty filter, replaced by save_load_filter.
+ */
+bool skip_build_for_load()
 {
+    if (load_file.empty())
+        return false;
+    std::cout << "[+] skipping the construction, the filter is loaded from " << load_file << std::endl;
+    test_out.add_measure("build_time", std::string("nan"));
+    test_out.add_measure("build_peak_rss_mb", std::string("nan"));
+    return true;
+}
+
+/**
+ * Runs the experiment as experiment() does, and calls 'after_build_f' on the data structure between the construction
+ * and the queries, outside the build measures (e.g. to save it to a file or to replace it with a loaded one).
+ */
+template <typename InitFun, typename AfterBuildFun, typename RangeFun, typename SizeFun, typename KeysType, typename QueriesType, typename... Args>
+void experiment_after_build(InitFun init_f, AfterBuildFun after_build_f, RangeFun range_f, SizeFun size_f, const double param,
+                            KeysType &keys, QueriesType &queries, Args... args)
+{
+    PerfCounters perf;
+    if (!perf.available())
+        std::cout << "[!] hardware performance counters not available" << std::endl;
+
+    perf.start();
     auto f = init_f(keys.begin(), keys.end(), param, args...);
+    perf.stop();
+    perf.add_measures(test_out, "build", keys.size());
+    after_build_f(f);
 
     std::cout << "[+] data structure constructed in " << test_out["build_time"] << "ms, starting queries" << std::endl;
     auto fp = 0, fn = 0;
+    LatencyHistogram latencies;
+    const auto overhead = latency_sample ? clock_overhead_ns() : 0;
+    auto next_sample = latency_sample;
+    perf.start();
     start_timer(query_time);
     for (auto q : queries)
     {
         const auto [left, right, original_result] = q;
 
-        bool query_result = range_f(f, left, right);
+        bool query_result;
+        if (latency_sample && --next_sample == 0)
+        {
+            /*
+             * The sampled queries are timed one by one, the overhead of the clock readings is subtracted from the
+             * measured latency.
+             */
+            next_sample = latency_sample;
+            auto t0 = std::chrono::steady_clock::now();
+            query_result = range_f(f, left, right);
+            auto t1 = std::chrono::steady_clock::now();
+            auto ns = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+            latencies.add(ns > overhead ? ns - overhead : 0);
+        }
+        else
+            query_result = range_f(f, left, right);
         if (query_result && !original_result)
             fp++;
         else if (!query_result && original_result)
@@ -63,6 +266,9 @@ void experiment(InitFun init_f, RangeFun range_f, SizeFun size_f, const double p
         }
     }
     stop_timer(query_time);
+    perf.stop();
+    perf.add_measures(test_out, "query", queries.size());
+    auto query_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t_end_query_time - t_start_query_time).count();
 
     auto size = size_f(f);
     test_out.add_measure("size", size);
@@ -72,11 +278,41 @@ void experiment(InitFun init_f, RangeFun range_f, SizeFun size_f, const double p
     test_out.add_measure("n_keys", keys.size());
     test_out.add_measure("n_queries", queries.size());
     test_out.add_measure("false_positives", fp);
+    test_out.add_measure("ns_per_query", (double) query_ns / queries.size());
+    test_out.add_measure("latency_sample", latency_sample);
+    test_out.add_measure("latency_samples", latencies.size());
+    test_out.add_measure("p50_ns", latencies.percentile(0.5));
+    test_out.add_measure("p99_ns", latencies.percentile(0.99));
+    test_out.add_measure("p999_ns", latencies.percentile(0.999));
+
+    test_out.add_measure("threads", query_threads);
+    if (query_threads > 1)
+        throughput_experiment(f, range_f, queries, query_threads);
+    else
+    {
+        test_out.add_measure("mt_mqueries_per_sec", (double) queries.size() / query_ns * 1000);
+        test_out.add_measure("mt_thread_ns_per_query", std::to_string((double) query_ns / queries.size()));
+        test_out.add_measure("mt_thread_ns_per_query_min", (double) query_ns / queries.size());
+        test_out.add_measure("mt_thread_ns_per_query_max", (double) query_ns / queries.size());
+    }
     std::cout << "[+] test executed successfully, printing stats and closing." << std::endl;
 }
 
-void init_parser(argparse::ArgumentParser &parser)
+template <typename InitFun, typename RangeFun, typename SizeFun, typename KeysType, typename QueriesType, typename... Args>
+void experiment(InitFun init_f, RangeFun range_f, SizeFun size_f, const double param, KeysType &keys, QueriesType &queries, Args... args)
+{
+    experiment_after_build(init_f, [](auto &) {}, range_f, size_f, param, keys, queries, args...);
+}
+
+/**
+ * Adds the common arguments of the benchmarks to 'parser'. The '--threads' argument is added only if
+ * 'thread_safe_queries' is true, i.e. if the queries of the benchmarked filter are known to be safe to run concurrently
+ * on a shared instance.
+ */
+void init_parser(argparse::ArgumentParser &parser, const bool thread_safe_queries = false)
 {
+    concurrent_queries = thread_safe_queries;
+
     parser.add_argument("arg")
             .help("the main parameter of the ds (typically desired bpk o #suffix bits)")
             .scan<'g', double>();
@@ -97,37 +333,115 @@ void init_parser(argparse::ArgumentParser &parser)
             .help("limits the maximum number of queries")
             .nargs(1)
             .scan<'i', int>();
+
+    parser.add_argument("--latency-sample")
+            .help("times one query every N queries and reports the p50, p99 and p99.9 latencies (0 to disable)")
+            .default_value(0)
+            .scan<'i', int>();
+
+    if (thread_safe_queries)
+        parser.add_argument("--threads")
+                .help("after the single-threaded run, runs the queries again on N pinned threads sharing the filter and reports the throughput")
+                .default_value(1)
+                .scan<'i', int>();
+
+    parser.add_argument("--mmap")
+            .help("how the binary keys and queries files are mapped: populate (prefaults the pages) or lazy")
+            .default_value(std::string("populate"));
+
+    parser.add_argument("--madvise")
+            .help("the access pattern advised for the mapped files: none, sequential, random or willneed")
+            .default_value(std::string("none"));
+
+    parser.add_argument("--skip-sorted-check")
+            .help("does not check that the keys are sorted after loading them")
+            .implicit_value(true)
+            .default_value(false);
 }
 
-std::tuple<InputKeys<uint64_t>, Workload<uint64_t>, double> read_parser_arguments(argparse::ArgumentParser &parser)
+/**
+ * Adds the arguments of save_load_filter to 'parser'. The 'options' are the arguments of the benchmark that must match
+ * between --save and --load.
+ */
+void add_save_load_arguments(argparse::ArgumentParser &parser, const std::string &options)
+{
+    parser.add_argument("--save")
+            .help("saves the filter to the given file after the construction, measuring the write throughput")
+            .nargs(1)
+            .default_value(std::string());
+    parser.add_argument("--load")
+            .help("skips the construction and loads the filter from the given file (saved with the same " + options
+                  + "), measuring the read throughput and the time to the first query")
+            .nargs(1)
+            .default_value(std::string());
+    parser.add_argument("--drop-cache")
+            .help("evicts the file of --load from the page cache before loading it (posix_fadvise)")
+            .implicit_value(true)
+            .default_value(false);
+}
+
+/**
+ * Reads the arguments added by add_save_load_arguments.
+ */
+void read_save_load_arguments(argparse::ArgumentParser &parser)
+{
+    save_file = parser.get<std::string>("save");
+    load_file = parser.get<std::string>("load");
+    drop_cache = parser.get<bool>("--drop-cache");
+    if (!save_file.empty() && !load_file.empty())
+        throw std::runtime_error("error, --save and --load cannot be used together.");
+}
+
+/**
+ * Reads the arguments of the benchmark and maps the keys and the queries files in memory (see MappedArray), so that
+ * the keys are read by the construction and the queries are iterated directly from the three mapped arrays.
+ */
+std::tuple<MappedArray<uint64_t>, MappedWorkload<uint64_t>, double> read_parser_arguments(argparse::ArgumentParser &parser)
 {
     auto arg = parser.get<double>("arg");
 
+    MapOptions map_options;
+    auto mmap_mode = parser.get<std::string>("--mmap");
+    auto advice = parser.get<std::string>("--madvise");
+    if (mmap_mode != "populate" && mmap_mode != "lazy")
+        throw std::runtime_error("error, mmap mode unknown.");
+    map_options.populate = (mmap_mode == "populate");
+    if (advice == "sequential")
+        map_options.advice = MapOptions::Advice::sequential;
+    else if (advice == "random")
+        map_options.advice = MapOptions::Advice::random;
+    else if (advice == "willneed")
+        map_options.advice = MapOptions::Advice::willneed;
+    else if (advice != "none")
+        throw std::runtime_error("error, madvise advice unknown.");
+
+    start_timer(load_time);
     auto keys_filename = parser.get<std::string>("keys");
-    auto keys = (has_suffix(keys_filename, ".txt")) ? read_keys_from_file<uint64_t>(keys_filename)
-                                                    : read_data_binary<uint64_t>(keys_filename);
+    auto keys = (has_suffix(keys_filename, ".txt")) ? MappedArray<uint64_t>(read_keys_from_file<uint64_t>(keys_filename))
+                                                    : MappedArray<uint64_t>::map_file(keys_filename, map_options);
     auto files = parser.get<std::vector<std::string>>("workload");
 
-    Workload<uint64_t> queries;
+    MappedWorkload<uint64_t> queries;
     if (has_suffix(files[0], ".txt"))
         exit(0);
     else
     {
-        auto left_q = read_data_binary<uint64_t>(files[0], false);
-        auto right_q = read_data_binary<uint64_t>(files[1], false);
+        auto left_q = MappedArray<uint64_t>::map_file(files[0], map_options);
+        auto right_q = MappedArray<uint64_t>::map_file(files[1], map_options);
 
         if (files.size() == 3)
-        {
-            auto res_q = read_data_binary<int>(files[2], false);
-
-            for (auto i = 0; i < left_q.size(); i++)
-                queries.emplace_back(left_q[i], right_q[i], res_q[i]);
-        }
+            queries = MappedWorkload<uint64_t>(left_q, right_q, MappedArray<int>::map_file(files[2], map_options));
         else
-            for (auto i = 0; i < left_q.size(); i++)
-                queries.emplace_back(left_q[i], right_q[i], false);
+            queries = MappedWorkload<uint64_t>(left_q, right_q);
     }
+    stop_timer(load_time);
 
+    /*
+     * The check reads all the keys, thus it is not part of the load time and it can be skipped to keep the pages of
+     * a lazy mapping untouched until the construction.
+     */
+    if (!parser.get<bool>("--skip-sorted-check") && !std::is_sorted(keys.begin(), keys.end()))
+        throw std::runtime_error("error, keys must be sorted.");
     if (keys.empty())
         throw std::runtime_error("error, keys file is empty.");
     if (queries.empty())
@@ -139,6 +453,10 @@ std::tuple<InputKeys<uint64_t>, Workload<uint64_t>, double> read_parser_argument
             queries.resize(*max_queries);
     }
 
+    latency_sample = std::max(0, parser.get<int>("--latency-sample"));
+    if (concurrent_queries)
+        query_threads = std::max(1, parser.get<int>("--threads"));
+
     if (auto arg_csv = parser.present<std::string>("--csv"))
     {
         print_csv = true;
@@ -20,6 +20,9 @@
 
 #include <iostream>
 #include <map>
+#include <chrono>
+#include <cmath>
+#include <vector>
 #include <set>
 #include <string>
 #include <algorithm>
@@ -28,6 +31,17 @@
 #include <fstream>
 #include <filesystem>
 #include <cstring>
+#include <memory>
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 /**
  * This file contains some utility functions and data structures used in the benchmarks.
@@ -102,6 +116,205 @@ std::vector<KeyType> read_data_binary(const std::string &filename, bool check_so
     return data;
 }
 
+/**
+ * A random-access iterator over a read-only container with 'operator[]', which returns the elements by value (e.g. the
+ * queries of a MappedWorkload, which are assembled from three arrays).
+ */
+template<typename Container>
+class IndexIterator {
+    const Container *c = nullptr;
+    std::ptrdiff_t i = 0;
+
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = typename Container::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = value_type;
+
+    IndexIterator() = default;
+
+    IndexIterator(const Container *c, std::ptrdiff_t i) : c(c), i(i) {}
+
+    reference operator*() const { return (*c)[i]; }
+
+    reference operator[](difference_type d) const { return (*c)[i + d]; }
+
+    IndexIterator &operator++() { ++i; return *this; }
+
+    IndexIterator operator++(int) { auto it = *this; ++i; return it; }
+
+    IndexIterator &operator--() { --i; return *this; }
+
+    IndexIterator operator--(int) { auto it = *this; --i; return it; }
+
+    IndexIterator &operator+=(difference_type d) { i += d; return *this; }
+
+    IndexIterator &operator-=(difference_type d) { i -= d; return *this; }
+
+    friend IndexIterator operator+(IndexIterator it, difference_type d) { return it += d; }
+
+    friend IndexIterator operator+(difference_type d, IndexIterator it) { return it += d; }
+
+    friend IndexIterator operator-(IndexIterator it, difference_type d) { return it -= d; }
+
+    friend difference_type operator-(const IndexIterator &a, const IndexIterator &b) { return a.i - b.i; }
+
+    friend bool operator==(const IndexIterator &a, const IndexIterator &b) { return a.i == b.i; }
+
+    friend bool operator!=(const IndexIterator &a, const IndexIterator &b) { return a.i != b.i; }
+
+    friend bool operator<(const IndexIterator &a, const IndexIterator &b) { return a.i < b.i; }
+
+    friend bool operator>(const IndexIterator &a, const IndexIterator &b) { return a.i > b.i; }
+
+    friend bool operator<=(const IndexIterator &a, const IndexIterator &b) { return a.i <= b.i; }
+
+    friend bool operator>=(const IndexIterator &a, const IndexIterator &b) { return a.i >= b.i; }
+};
+
+/**
+ * The options of the memory mapping of the binary files: 'populate' prefaults the pages when the file is mapped
+ * (MAP_POPULATE), so that the first accesses do not page fault, and 'advice' is passed to madvise.
+ */
+struct MapOptions {
+    enum class Advice { none, sequential, random, willneed };
+
+    bool populate = true;
+    Advice advice = Advice::none;
+};
+
+/**
+ * A read-only view of the elements of a binary file in the format of read_data_binary (the number of elements followed
+ * by the elements), mapped in memory, so that the file is neither read nor copied up front. The view can also own a
+ * vector (e.g. the keys read from a text file). The copies of a view share the same mapping, which is released with
+ * the last copy. On platforms other than Linux, the file is read with read_data_binary.
+ */
+template<typename T>
+class MappedArray {
+    std::shared_ptr<const void> storage;
+    const T *ptr = nullptr;
+    size_t n = 0;
+
+public:
+    using value_type = T;
+    using const_iterator = IndexIterator<MappedArray>;
+    using iterator = const_iterator;
+
+    MappedArray() = default;
+
+    explicit MappedArray(std::vector<T> &&v) {
+        auto owned = std::make_shared<const std::vector<T>>(std::move(v));
+        ptr = owned->data();
+        n = owned->size();
+        storage = owned;
+    }
+
+    static MappedArray map_file(const std::string &filename, const MapOptions &options = {}) {
+#ifdef __linux__
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat st{};
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            if (fd >= 0)
+                close(fd);
+            throw std::runtime_error("error, could not open the file " + filename);
+        }
+        const auto length = (size_t) st.st_size;
+        if (length < sizeof(T)) {
+            close(fd);
+            throw std::runtime_error("error, the file " + filename + " is truncated");
+        }
+
+        auto *addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE | (options.populate ? MAP_POPULATE : 0), fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error("error, could not map the file " + filename);
+        constexpr int advice[] = {MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED};
+        if (options.advice != MapOptions::Advice::none)
+            madvise(addr, length, advice[(int) options.advice]);
+
+        MappedArray a;
+        a.storage = std::shared_ptr<const void>(addr, [length](const void *p) { munmap(const_cast<void *>(p), length); });
+        T size;
+        memcpy(&size, addr, sizeof(T));
+        if ((uint64_t) size > (length - sizeof(T)) / sizeof(T))
+            throw std::runtime_error("error, the file " + filename + " is truncated");
+        a.ptr = reinterpret_cast<const T *>(static_cast<const char *>(addr) + sizeof(T));
+        a.n = size;
+        return a;
+#else
+        return MappedArray(read_data_binary<T>(filename, false));
+#endif
+    }
+
+    const T *data() const { return ptr; }
+
+    size_t size() const { return n; }
+
+    bool empty() const { return n == 0; }
+
+    const T &operator[](size_t i) const { return ptr[i]; }
+
+    const T &front() const { return ptr[0]; }
+
+    const T &back() const { return ptr[n - 1]; }
+
+    const_iterator begin() const { return {this, 0}; }
+
+    const_iterator end() const { return {this, (std::ptrdiff_t) n}; }
+
+    /**
+     * Shrinks the view to its first 'count' elements.
+     */
+    void resize(size_t count) {
+        if (count > n)
+            throw std::runtime_error("error, a mapped array cannot grow");
+        n = count;
+    }
+};
+
+/**
+ * The queries of a workload as the three arrays of its binary files (the left and the right endpoints, and the
+ * optional expected results), which are iterated as the tuples of a Workload without assembling them in memory.
+ */
+template<typename KeyType>
+class MappedWorkload {
+    MappedArray<KeyType> left, right;
+    MappedArray<int> result;
+
+public:
+    using value_type = std::tuple<KeyType, KeyType, bool>;
+    using const_iterator = IndexIterator<MappedWorkload>;
+    using iterator = const_iterator;
+
+    MappedWorkload() = default;
+
+    MappedWorkload(MappedArray<KeyType> left, MappedArray<KeyType> right, MappedArray<int> result = {})
+            : left(std::move(left)), right(std::move(right)), result(std::move(result)) {
+        if (this->left.size() != this->right.size() || (!this->result.empty() && this->result.size() != this->left.size()))
+            throw std::runtime_error("error, the workload files have different sizes");
+    }
+
+    size_t size() const { return left.size(); }
+
+    bool empty() const { return left.empty(); }
+
+    value_type operator[](size_t i) const { return {left[i], right[i], !result.empty() && result[i]}; }
+
+    const_iterator begin() const { return {this, 0}; }
+
+    const_iterator end() const { return {this, (std::ptrdiff_t) size()}; }
+
+    /**
+     * Shrinks the workload to its first 'count' queries.
+     */
+    void resize(size_t count) {
+        left.resize(count), right.resize(count);
+        if (!result.empty())
+            result.resize(count);
+    }
+};
+
 template<typename KeyType>
 void write_to_binary_file(const KeyType &data, const std::string &path, bool write_size = true) {
     using value_type = typename KeyType::value_type;
@@ -250,3 +463,229 @@ public:
     }
 
 };
+
+/**
+ * An HDR-style histogram of latencies in nanoseconds. The values are grouped by their highest set bit, and each group
+ * is split into 2^sub_bucket_bits linear sub-buckets, thus the relative error of the percentiles is at most
+ * 2^-sub_bucket_bits (about 3%) at any scale, and the histogram takes a fixed amount of memory.
+ */
+class LatencyHistogram {
+    static constexpr int sub_bucket_bits = 5;
+    static constexpr uint64_t sub_buckets = uint64_t(1) << sub_bucket_bits;
+
+    std::vector<uint64_t> counts = std::vector<uint64_t>((64 - sub_bucket_bits + 1) * sub_buckets, 0);
+    uint64_t n_values = 0;
+
+    static size_t bucket_of(const uint64_t v) {
+        if (v < sub_buckets)
+            return v;
+        const int msb = 63 - __builtin_clzll(v);
+        const int shift = msb - sub_bucket_bits;
+        return (shift + 1) * sub_buckets + ((v >> shift) - sub_buckets);
+    }
+
+    /* returns the largest value mapped to the bucket 'b' */
+    static uint64_t bucket_value(const size_t b) {
+        if (b < sub_buckets)
+            return b;
+        const int shift = int(b / sub_buckets) - 1;
+        return ((sub_buckets + b % sub_buckets + 1) << shift) - 1;
+    }
+
+public:
+    inline void add(const uint64_t ns) {
+        counts[bucket_of(ns)]++;
+        n_values++;
+    }
+
+    uint64_t size() const {
+        return n_values;
+    }
+
+    /**
+     * Returns the value below which falls the fraction 'q' of the recorded values, 0 if the histogram is empty.
+     */
+    uint64_t percentile(const double q) const {
+        if (n_values == 0)
+            return 0;
+        const auto rank = std::max<uint64_t>(1, std::ceil(q * n_values));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < counts.size(); ++b) {
+            seen += counts[b];
+            if (seen >= rank)
+                return bucket_value(b);
+        }
+        return bucket_value(counts.size() - 1);
+    }
+};
+
+/**
+ * A set of hardware performance counters, read via perf_event_open on Linux. The counters are opened in user space only
+ * for the calling thread and, as they are inherited, for the threads it creates afterwards (e.g. the pools of the
+ * parallel construction), whose events are summed when the counters are read. Threads created before the counters are
+ * not counted. The counters form a single group, so that they are scheduled on the PMU together and the ratios among
+ * them (e.g. the ipc) refer to the same instructions; the group is scaled by the fraction of time it was scheduled. The
+ * counters that cannot be opened (e.g. on virtual machines, on other platforms or with a restrictive
+ * perf_event_paranoid) are reported as "nan".
+ */
+class PerfCounters {
+    struct Counter {
+        std::string name;
+        uint32_t type;
+        uint64_t config;
+        int fd = -1;
+        double value = 0;
+    };
+
+    std::vector<Counter> counters;
+    int leader_fd = -1;
+    size_t n_open = 0;
+
+    static constexpr uint64_t cache_event(uint64_t cache, uint64_t op, uint64_t result) {
+        return cache | (op << 8) | (result << 16);
+    }
+
+public:
+    PerfCounters() {
+#ifdef __linux__
+        counters = {
+                {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+                {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+                {"l1d_misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+                {"dtlb_misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)}
+        };
+        for (auto &c: counters) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = c.type;
+            attr.config = c.config;
+            attr.disabled = leader_fd < 0; /* the members are enabled and disabled with the leader */
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            c.fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, leader_fd, 0);
+            if (c.fd >= 0) {
+                if (leader_fd < 0)
+                    leader_fd = c.fd;
+                ++n_open;
+            }
+        }
+#else
+        for (auto name: {"cycles", "instructions", "cache_misses", "branch_misses", "l1d_misses", "dtlb_misses"})
+            counters.push_back({name, 0, 0});
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (auto &c: counters)
+            if (c.fd >= 0)
+                close(c.fd);
+#endif
+    }
+
+    bool available() const {
+        return std::any_of(counters.begin(), counters.end(), [](auto &c) { return c.fd >= 0; });
+    }
+
+    void start() {
+#ifdef __linux__
+        if (leader_fd >= 0) {
+            ioctl(leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        if (leader_fd < 0)
+            return;
+        ioctl(leader_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        /* number of counters, time enabled, time running, then the values in the order the counters were opened */
+        std::vector<uint64_t> buf(3 + n_open, 0);
+        const auto size = (ssize_t) (buf.size() * sizeof(uint64_t));
+        const auto valid = read(leader_fd, buf.data(), size) == size && buf[0] == n_open && buf[2] != 0;
+        size_t i = 3;
+        for (auto &c: counters) {
+            if (c.fd < 0)
+                continue;
+            c.value = valid ? (double) buf[i] * ((double) buf[1] / buf[2]) : std::nan("");
+            ++i;
+        }
+#endif
+    }
+
+    /**
+     * Adds the counters of the last measured phase to 'out' as '<prefix>_<counter>', divided by 'n' (e.g. the number
+     * of queries), plus the instructions per cycle as '<prefix>_ipc'.
+     */
+    template<typename Output>
+    void add_measures(Output &out, const std::string &prefix, const uint64_t n) const {
+        double cycles = std::nan(""), instructions = std::nan("");
+        for (auto &c: counters) {
+            if (c.fd < 0 || std::isnan(c.value) || n == 0)
+                out.add_measure(prefix + "_" + c.name, std::string("nan"));
+            else
+                out.add_measure(prefix + "_" + c.name, c.value / n);
+            if (c.name == "cycles" && c.fd >= 0) cycles = c.value;
+            if (c.name == "instructions" && c.fd >= 0) instructions = c.value;
+        }
+        if (std::isnan(cycles) || std::isnan(instructions) || cycles == 0)
+            out.add_measure(prefix + "_ipc", std::string("nan"));
+        else
+            out.add_measure(prefix + "_ipc", instructions / cycles);
+    }
+};
+
+/**
+ * Resets the peak resident set size of the process, so that 'peak_rss_bytes' returns the peak of the next phase. It is
+ * supported on Linux only (by writing to /proc/self/clear_refs), elsewhere the peak is the one since the process start.
+ */
+inline void reset_peak_rss() {
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+/**
+ * Returns the peak resident set size of the process in bytes, read from the VmHWM field of /proc/self/status or, if
+ * it is not available, from getrusage.
+ */
+inline uint64_t peak_rss_bytes() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.rfind("VmHWM:", 0) == 0)
+            return std::stoull(line.substr(6)) * 1024;
+#ifdef __linux__
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return (uint64_t) usage.ru_maxrss * 1024;
+#endif
+    return 0;
+}
+
+/**
+ * Evicts the pages of the file 'path' from the page cache, so that the next read of the file comes from the disk. The
+ * dirty pages are written back first, as they cannot be evicted. Returns false if the eviction is not supported.
+ */
+inline bool drop_file_cache(const std::string &path) {
+#ifdef __linux__
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    auto ok = fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+#else
+    return false;
+#endif
+}
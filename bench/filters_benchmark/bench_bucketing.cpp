@@ -25,35 +25,76 @@
 
 auto default_container = "sux";
 
-template <typename REContainer, typename t_itr>
-inline grafite::bucket<REContainer> init_bucketing(const t_itr begin, const t_itr end, const double s)
+template <typename REContainer, bool pow2_buckets, typename t_itr>
+inline grafite::bucket<REContainer, pow2_buckets> init_bucketing(const t_itr begin, const t_itr end, const double s)
 {
+    if (skip_build_for_load())
+        return {};
+
     start_timer(build_time);
-    grafite::bucket<REContainer> filter(begin, end, s);
+    grafite::bucket<REContainer, pow2_buckets> filter(begin, end, s);
     stop_timer(build_time);
     return filter;
 }
 
-template <typename REContainer, typename value_type>
-inline bool query_bucketing(grafite::bucket<REContainer> &f, const value_type left, const value_type right)
+/**
+ * Measures the size of the filter with the default rounding of the bucket size, to compare the space of the
+ * power-of-two buckets with it. The reference bucket is built after the build measures are taken (see
+ * experiment_after_build), so that the performance counters of the construction count only the benchmarked one.
+ */
+template <typename REContainer, bool pow2_buckets, typename KeysType>
+void measure_default_rounding(const grafite::bucket<REContainer, pow2_buckets> &filter, const KeysType &keys, const double s)
+{
+    size_t default_size = filter.size();
+    if constexpr (pow2_buckets)
+        default_size = grafite::bucket<REContainer>(keys.begin(), keys.end(), s).size();
+    test_out.add_measure("size_default_rounding", default_size);
+    test_out.add_measure("bpk_default_rounding", TO_BPK(default_size, keys.size()));
+}
+
+template <typename REContainer, bool pow2_buckets, typename value_type>
+inline bool query_bucketing(grafite::bucket<REContainer, pow2_buckets> &f, const value_type left, const value_type right)
 {
     return f.query(left, right);
 }
 
-template <typename REContainer>
-inline size_t size_bucketing(const grafite::bucket<REContainer> &f)
+template <typename REContainer, bool pow2_buckets>
+inline size_t size_bucketing(const grafite::bucket<REContainer, pow2_buckets> &f)
 {
     return f.size();
 }
 
+template <bool pow2_buckets>
+void run_bucketing(const std::string &container, const double arg, MappedArray<uint64_t> &keys, MappedWorkload<uint64_t> &queries)
+{
+    auto after_build = [&keys, arg](auto &f)
+    {
+        save_load_filter(f, keys.begin());
+        measure_default_rounding(f, keys, arg);
+    };
+    if (container == "sux")
+        experiment_after_build(pass_fun((init_bucketing<grafite::ef_sux_vector, pow2_buckets>)), after_build,
+            pass_ref(query_bucketing), pass_ref(size_bucketing), arg, keys, queries);
+    else if (container == "sdsl")
+        experiment_after_build(pass_fun((init_bucketing<grafite::ef_sdsl_vector, pow2_buckets>)), after_build,
+            pass_ref(query_bucketing), pass_ref(size_bucketing), arg, keys, queries);
+    else
+        throw std::runtime_error("error, range emptiness data structure unknown.");
+}
+
 int main(int argc, char const *argv[])
 {
     argparse::ArgumentParser parser("bench-bucketing");
-    init_parser(parser);
+    init_parser(parser, true); /* the queries are const */
     parser.add_argument("--ds")
         .nargs(1)
         .required()
         .default_value(default_container);
+    parser.add_argument("--pow2")
+        .help("rounds the size of the buckets to a power of two")
+        .implicit_value(true)
+        .default_value(false);
+    add_save_load_arguments(parser, "--ds and --pow2");
 
     try
     {
@@ -68,6 +109,7 @@ int main(int argc, char const *argv[])
 
     auto [ keys, queries, arg ] = read_parser_arguments(parser);
     auto container = parser.get<std::string>("ds");
+    read_save_load_arguments(parser);
 
     if (keys.back() == std::numeric_limits<uint64_t>::max())
         keys.resize(keys.size() - 1);
@@ -75,15 +117,14 @@ int main(int argc, char const *argv[])
     if (L == 0) ++L;
 
     std::cout << "[+] expected fpr: " << (double) L/std::exp2(arg - 2) << std::endl;
-    std::cout << "[+] using container `" << container << "`" << std::endl;
-    if (container == "sux")
-        experiment(pass_fun(init_bucketing<grafite::ef_sux_vector>),pass_ref(query_bucketing),
-            pass_ref(size_bucketing), arg, keys, queries);
-    else if (container == "sdsl")
-        experiment(pass_fun(init_bucketing<grafite::ef_sdsl_vector>),pass_ref(query_bucketing),
-            pass_ref(size_bucketing), arg, keys, queries);
+    auto pow2 = parser.get<bool>("--pow2");
+    test_out.add_measure("pow2", pow2);
+
+    std::cout << "[+] using container `" << container << "`" << (pow2 ? " with power-of-two buckets" : "") << std::endl;
+    if (pow2)
+        run_bucketing<true>(container, arg, keys, queries);
     else
-        throw std::runtime_error("error, range emptiness data structure unknown.");
+        run_bucketing<false>(container, arg, keys, queries);
     print_test();
 
     return 0;
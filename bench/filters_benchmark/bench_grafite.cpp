@@ -24,36 +24,90 @@
  */
 
 auto default_container = "sux";
+auto default_hash = "modular";
+auto default_sort = "auto";
+grafite::build_options build_opts;
 
-template <typename REContainer, typename t_itr>
-inline grafite::filter<REContainer> init_grafite(const t_itr begin, const t_itr end, const double bpk)
+template <typename REContainer, bool pow2_universe, typename HashPolicy, typename t_itr>
+inline grafite::filter<REContainer, 2, pow2_universe, HashPolicy> init_grafite(const t_itr begin, const t_itr end, const double bpk)
 {
+    /*
+     * The time and the peak resident memory of each phase of the construction are measured from the end of the
+     * previous phase, and the peak memory is reset at the end of each phase.
+     */
+    if (skip_build_for_load())
+        return {};
+
+    reset_peak_rss();
+    auto options = build_opts;
+    auto phase_start = timer::now();
+    uint64_t build_peak_rss = 0;
+    options.on_phase_end = [&](const grafite::build_phase phase)
+    {
+        auto phase_end = timer::now();
+        auto name = "build_" + grafite::to_string(phase);
+        test_out.add_measure(name + "_ms", std::chrono::duration<double, std::milli>(phase_end - phase_start).count());
+        auto phase_peak_rss = peak_rss_bytes();
+        build_peak_rss = std::max(build_peak_rss, phase_peak_rss);
+        test_out.add_measure(name + "_peak_rss_mb", TO_MB(phase_peak_rss));
+        reset_peak_rss();
+        phase_start = timer::now();
+    };
+
     start_timer(build_time);
-    grafite::filter<REContainer> filter(begin, end, bpk);
+    grafite::filter<REContainer, 2, pow2_universe, HashPolicy> filter(begin, end, bpk, options);
     stop_timer(build_time);
+    test_out.add_measure("build_peak_rss_mb", TO_MB(build_peak_rss));
     return filter;
 }
 
-template <typename value_type, typename REContainer>
-inline bool query_grafite(grafite::filter<REContainer> &f, const value_type left, const value_type right)
+template <typename value_type, typename FilterType>
+inline bool query_grafite(FilterType &f, const value_type left, const value_type right)
 {
     return f.query(left, right);
 }
 
-template <typename REContainer>
-inline size_t size_grafite(const grafite::filter<REContainer> &f)
+template <typename FilterType>
+inline size_t size_grafite(const FilterType &f)
 {
     return f.size();
 }
 
+template <bool pow2_universe, typename HashPolicy = grafite::modular_hash<pow2_universe>>
+void run_grafite(const std::string &container, const double arg, MappedArray<uint64_t> &keys, MappedWorkload<uint64_t> &queries)
+{
+    auto save_load = [&keys](auto &f) { save_load_filter(f, keys.begin()); };
+    if (container == "sux")
+        experiment_after_build(pass_fun((init_grafite<grafite::ef_sux_vector, pow2_universe, HashPolicy>)), save_load,
+                               pass_ref(query_grafite), pass_ref(size_grafite), arg, keys, queries);
+    else if (container == "sdsl")
+        experiment_after_build(pass_fun((init_grafite<grafite::ef_sdsl_vector, pow2_universe, HashPolicy>)), save_load,
+                               pass_ref(query_grafite), pass_ref(size_grafite), arg, keys, queries);
+    else
+        throw std::runtime_error("error, range emptiness data structure unknown.");
+}
+
 int main(int argc, char const *argv[])
 {
     argparse::ArgumentParser parser("bench-grafite");
-    init_parser(parser);
+    init_parser(parser, true); /* the queries are const and the query-path counters are per thread */
     parser.add_argument("--ds")
         .nargs(1)
         .required()
         .default_value(default_container);
+    parser.add_argument("--pow2")
+        .help("rounds the size of the reduced universe to a power of two")
+        .implicit_value(true)
+        .default_value(false);
+    parser.add_argument("--hash")
+        .help("the hash policy: modular, multiply-shift or keyed")
+        .nargs(1)
+        .default_value(default_hash);
+    parser.add_argument("--sort")
+        .help("the sort algorithm used in the construction: auto, std, spreadsort, parallel or radix")
+        .nargs(1)
+        .default_value(default_sort);
+    add_save_load_arguments(parser, "--ds, --hash and --pow2");
 
     try
     {
@@ -69,15 +123,46 @@ int main(int argc, char const *argv[])
     auto [ keys, queries, arg ] = read_parser_arguments(parser);
     auto container = parser.get<std::string>("ds");
 
-    std::cout << "[+] using container `" << container << "`" << std::endl;
-    if (container == "sux")
-        experiment(pass_fun(init_grafite<grafite::ef_sux_vector>),pass_ref(query_grafite),
-                pass_ref(size_grafite), arg, keys, queries);
-    else if (container == "sdsl")
-        experiment(pass_fun(init_grafite<grafite::ef_sdsl_vector>),pass_ref(query_grafite),
-                   pass_ref(size_grafite), arg, keys, queries);
+    auto pow2 = parser.get<bool>("--pow2");
+    auto hash = parser.get<std::string>("hash");
+    /*
+     * The hash policy decides the size of the reduced universe, thus the multiply-shift policy always rounds it to a
+     * power of two and the keyed policy never does, whatever the value of --pow2.
+     */
+    if (hash == "multiply-shift" || hash == "keyed")
+    {
+        if (pow2 != (hash == "multiply-shift"))
+            std::cout << "[!] --pow2 is ignored by the `" << hash << "` hash" << std::endl;
+        pow2 = (hash == "multiply-shift");
+    }
+    test_out.add_measure("pow2", pow2);
+    test_out.add_measure("hash", hash);
+    build_opts.sort = grafite::sort_backend_from_string(parser.get<std::string>("sort"));
+    test_out.add_measure("sort", grafite::to_string(build_opts.sort));
+    read_save_load_arguments(parser);
+
+    std::cout << "[+] using container `" << container << "` and hash `" << hash << "`"
+              << (pow2 ? " with power-of-two universe" : "") << std::endl;
+    if (hash == "multiply-shift")
+        run_grafite<true, grafite::multiply_shift_hash>(container, arg, keys, queries);
+    else if (hash == "keyed")
+        run_grafite<false, grafite::keyed_hash>(container, arg, keys, queries);
+    else if (hash != "modular")
+        throw std::runtime_error("error, hash policy unknown.");
+    else if (pow2)
+        run_grafite<true>(container, arg, keys, queries);
     else
-        throw std::runtime_error("error, range emptiness data structure unknown.");
+        run_grafite<false>(container, arg, keys, queries);
+
+#ifdef GRAFITE_QUERY_STATS
+    auto stats = grafite::query_stats::snapshot();
+    std::cout << "[+] query path stats:\n" << stats;
+    for (size_t p = 0; p < grafite::n_query_paths; ++p)
+        test_out.add_measure(std::string("path_") + grafite::to_string(grafite::query_path(p)), stats.queries[p]);
+    for (size_t t = 0; t < grafite::n_query_timers; ++t)
+        test_out.add_measure(std::string(grafite::to_string(grafite::query_timer(t))) + "_ns",
+                             stats.calls[t] ? double(stats.nanoseconds[t]) / stats.calls[t] : 0.0);
+#endif
 
     print_test();
 
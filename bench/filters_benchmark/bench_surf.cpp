@@ -76,7 +76,7 @@ int main(int argc, char const *argv[])
     auto surf_hash = true;
 
     // Check if all the queries are point queries, if so we use the hash version of SuRF, otherwise we use the real version.
-    for (auto & it : queries)
+    for (const auto &it : queries)
         if (std::get<0>(it) != std::get<1>(it))
         {
             surf_hash = false;
@@ -0,0 +1,251 @@
+/*
+ * This file is part of Grafite <https://github.com/marcocosta97/grafite>.
+ * Copyright (C) 2023 Marco Costa.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+#include <functional>
+#include <numeric>
+#include <iomanip>
+
+#include "bench_utils.hpp"
+#include "grafite/grafite.hpp"
+#include <argparse/argparse.hpp>
+
+/**
+ * This file contains the microbenchmarks of the components of grafite.hpp: the hashing of the keys, the sort backends,
+ * the construction of the Elias-Fano containers, their emptiness queries and the queries of the bucket. Each case is
+ * run once to warm up the caches and the branch predictors, then timed 'reps' times, and the mean, median, standard
+ * deviation and minimum of the time per operation are reported.
+ */
+
+int reps = 10;
+bool print_csv = false;
+std::string csv_file;
+
+template <class T>
+inline void do_not_optimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * Runs 'setup' and 'f' once as warm-up, then 'reps' times, timing only 'f', which performs 'n_ops' operations.
+ */
+void run_case(const std::string &name, const uint64_t n, const double bpk, const uint64_t n_ops,
+              const std::function<void()> &setup, const std::function<void()> &f)
+{
+    std::vector<double> ns_per_op;
+    setup();
+    f();
+    for (auto i = 0; i < reps; i++)
+    {
+        setup();
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        auto t1 = std::chrono::steady_clock::now();
+        ns_per_op.push_back((double) std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / n_ops);
+    }
+
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+    auto mean = std::accumulate(ns_per_op.begin(), ns_per_op.end(), 0.0) / ns_per_op.size();
+    auto median = ns_per_op[ns_per_op.size() / 2];
+    auto var = 0.0;
+    for (auto v : ns_per_op)
+        var += (v - mean) * (v - mean);
+    auto stddev = ns_per_op.size() > 1 ? std::sqrt(var / (ns_per_op.size() - 1)) : 0.0;
+
+    std::cout << std::fixed << std::setprecision(2) << std::left << std::setw(28) << name << " n=" << std::setw(10) << n
+              << " bpk=" << std::setw(6) << bpk << " mean=" << mean << "ns median=" << median
+              << "ns stddev=" << stddev << "ns min=" << ns_per_op.front() << "ns" << std::endl;
+
+    if (print_csv)
+    {
+        TestOutput out;
+        out.add_measure("case", name);
+        out.add_measure("n", n);
+        out.add_measure("bpk", bpk);
+        out.add_measure("reps", reps);
+        out.add_measure("mean_ns", mean);
+        out.add_measure("median_ns", median);
+        out.add_measure("stddev_ns", stddev);
+        out.add_measure("min_ns", ns_per_op.front());
+        std::filesystem::path path_csv(csv_file);
+        auto header = !std::filesystem::exists(path_csv) || std::filesystem::is_empty(path_csv);
+        std::ofstream(path_csv, std::ios::app) << out.to_csv(header);
+    }
+}
+
+void run_all(const uint64_t n, const double bpk, const uint64_t n_queries, const uint64_t range_size)
+{
+    std::mt19937_64 gen(n);
+    std::vector<uint64_t> keys(n);
+    for (auto &k : keys)
+        k = gen() >> 1;
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    const auto n_keys = keys.size();
+    const uint64_t r = std::ceil(n_keys * std::exp2(bpk - 2));
+
+    /* filter::hash, one key at a time and in batch */
+    grafite::modular_hash<> h;
+    h.init(r);
+    std::vector<uint64_t> hashes(n_keys);
+    run_case("hash", n_keys, bpk, n_keys, [] {}, [&] {
+        for (size_t i = 0; i < n_keys; ++i)
+            hashes[i] = h(keys[i], r);
+        do_not_optimize(hashes.back());
+    });
+    run_case("hash_batch", n_keys, bpk, n_keys, [] {}, [&] {
+        h(keys.begin(), keys.end(), hashes.begin(), r);
+        do_not_optimize(hashes.back());
+    });
+
+    /* sort backends */
+    std::vector<uint64_t> to_sort;
+    for (auto backend : {grafite::sort_backend::std_sort, grafite::sort_backend::spreadsort,
+                         grafite::sort_backend::parallel_block, grafite::sort_backend::radix})
+    {
+        grafite::build_options options;
+        options.sort = backend;
+        run_case("sort_" + grafite::to_string(backend), n_keys, bpk, n_keys, [&] { to_sort = hashes; }, [&] {
+            grafite::sort_keys(to_sort, r - 1, options);
+            do_not_optimize(to_sort.front());
+        });
+    }
+    std::vector<uint64_t> sorted_hashes(hashes);
+    std::sort(sorted_hashes.begin(), sorted_hashes.end());
+
+    /* Elias-Fano construction */
+    run_case("ef_sux_build", n_keys, bpk, n_keys, [] {}, [&] {
+        grafite::ef_sux_vector ef(sorted_hashes.begin(), sorted_hashes.end());
+        do_not_optimize(ef);
+    });
+    run_case("ef_sdsl_build", n_keys, bpk, n_keys, [] {}, [&] {
+        grafite::ef_sdsl_vector ef(sorted_hashes.begin(), sorted_hashes.end());
+        do_not_optimize(ef);
+    });
+
+    /*
+     * Elias-Fano emptiness queries on random ranges of the reduced universe. The ranges lie in [0, max hash], thus
+     * their size is clamped to the span of the hashes, which may be smaller than 'range_size' for small inputs.
+     */
+    const auto ef_range_size = std::min<uint64_t>(range_size, sorted_hashes.back() + 1);
+    std::vector<uint64_t> lefts(n_queries);
+    for (auto &l : lefts)
+        l = gen() % (sorted_hashes.back() - ef_range_size + 2);
+
+    grafite::ef_sux_vector ef_sux(sorted_hashes.begin(), sorted_hashes.end());
+    run_case("ef_sux_check_presence", n_keys, bpk, n_queries, [] {}, [&] {
+        size_t res = 0;
+        for (auto l : lefts)
+            res += ef_sux.check_presence(l, l + ef_range_size - 1);
+        do_not_optimize(res);
+    });
+    run_case("ef_sux_check_presence_bs", n_keys, bpk, n_queries, [] {}, [&] {
+        size_t res = 0;
+        for (auto l : lefts)
+            res += ef_sux.check_presence_bs(l, l + ef_range_size - 1);
+        do_not_optimize(res);
+    });
+
+    grafite::ef_sdsl_vector ef_sdsl(sorted_hashes.begin(), sorted_hashes.end());
+    run_case("ef_sdsl_rank", n_keys, bpk, n_queries, [] {}, [&] {
+        size_t res = 0;
+        for (auto l : lefts)
+            res += ef_sdsl.check_presence(l, l + ef_range_size - 1);
+        do_not_optimize(res);
+    });
+
+    /* bucket::query on random ranges of the key universe */
+    grafite::bucket<grafite::ef_sux_vector> b(keys.begin(), keys.end(), bpk);
+    std::vector<uint64_t> key_lefts(n_queries);
+    for (auto &l : key_lefts)
+        l = gen() >> 1;
+    run_case("bucket_query", n_keys, bpk, n_queries, [] {}, [&] {
+        size_t res = 0;
+        for (auto l : key_lefts)
+            res += b.query(l, l + range_size - 1);
+        do_not_optimize(res);
+    });
+}
+
+int main(int argc, char const *argv[])
+{
+    argparse::ArgumentParser parser("microbench");
+
+    parser.add_argument("-n", "--n-keys")
+            .help("the numbers of keys")
+            .nargs(argparse::nargs_pattern::at_least_one)
+            .default_value(std::vector<int>{1 << 16, 1 << 20})
+            .scan<'i', int>();
+
+    parser.add_argument("-b", "--bpk")
+            .help("the bits per key")
+            .nargs(argparse::nargs_pattern::at_least_one)
+            .default_value(std::vector<double>{10, 16})
+            .scan<'g', double>();
+
+    parser.add_argument("--queries")
+            .help("the number of queries of the query cases")
+            .default_value(1'000'000)
+            .scan<'i', int>();
+
+    parser.add_argument("--range-size")
+            .help("the size of the ranges of the query cases")
+            .default_value(32)
+            .scan<'i', int>();
+
+    parser.add_argument("--reps")
+            .help("the number of timed repetitions of each case")
+            .default_value(10)
+            .scan<'i', int>();
+
+    parser.add_argument("--csv")
+            .help("appends the results in csv")
+            .nargs(1);
+
+    try
+    {
+        parser.parse_args(argc, argv);
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << err.what() << std::endl;
+        std::cerr << parser;
+        std::exit(1);
+    }
+
+    reps = std::max(1, parser.get<int>("--reps"));
+    if (auto arg_csv = parser.present<std::string>("--csv"))
+    {
+        print_csv = true;
+        csv_file = *arg_csv;
+    }
+
+    if (parser.get<int>("--range-size") < 1)
+        throw std::runtime_error("error, the range size must be positive");
+    for (auto n : parser.get<std::vector<int>>("--n-keys"))
+    {
+        if (n < 1)
+            throw std::runtime_error("error, the number of keys must be positive");
+
+        for (auto bpk : parser.get<std::vector<double>>("--bpk"))
+            run_all(n, bpk, parser.get<int>("--queries"), parser.get<int>("--range-size"));
+    }
+
+    return 0;
+}
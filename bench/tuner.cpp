@@ -0,0 +1,124 @@
+/*
+ * This file is part of Grafite <https://github.com/marcocosta97/grafite>.
+ * Copyright (C) 2023 Marco Costa.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include "bench_utils.hpp"
+#include "grafite/tuner.hpp"
+#include <argparse/argparse.hpp>
+
+/**
+ * This file contains a command line tool that picks the parameters of a range filter from the keys and a query
+ * sample in the binary format produced by `workload_gen`.
+ */
+
+int main(int argc, char const *argv[])
+{
+    argparse::ArgumentParser parser("tuner");
+
+    parser.add_argument("-k", "--keys")
+            .help("pass the keys from file")
+            .required()
+            .nargs(1);
+
+    parser.add_argument("-w", "--workload")
+            .help("pass the query sample from file (left and right endpoints)")
+            .required()
+            .nargs(2, 3);
+
+    parser.add_argument("-b", "--budget")
+            .help("the memory budget of the filter, in bits per key")
+            .required()
+            .scan<'g', double>();
+
+    parser.add_argument("--L-quantile")
+            .help("the quantile of the query lengths used as the parameter L of grafite")
+            .default_value(1.0)
+            .scan<'g', double>();
+
+    parser.add_argument("--max-queries")
+            .help("limits the maximum number of queries evaluated by the tuner")
+            .default_value(100'000)
+            .scan<'i', int>();
+
+    parser.add_argument("--max-sample-keys")
+            .help("the maximum number of keys of the subsample over which the candidates are built")
+            .default_value(1 << 20)
+            .scan<'i', int>();
+
+    parser.add_argument("--no-confirm")
+            .help("does not build the recommended filter over all the keys to measure its size and fpr")
+            .implicit_value(true)
+            .default_value(false);
+
+    try
+    {
+        parser.parse_args(argc, argv);
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << err.what() << std::endl;
+        std::cerr << parser;
+        std::exit(1);
+    }
+
+    auto keys_filename = parser.get<std::string>("keys");
+    auto keys = (has_suffix(keys_filename, ".txt")) ? read_keys_from_file<uint64_t>(keys_filename)
+                                                    : read_data_binary<uint64_t>(keys_filename);
+    if (keys.empty())
+        throw std::runtime_error("error, keys file is empty.");
+    if (keys.back() == std::numeric_limits<uint64_t>::max())
+        keys.resize(keys.size() - 1);
+
+    auto files = parser.get<std::vector<std::string>>("workload");
+    auto left_q = read_data_binary<uint64_t>(files[0], false);
+    auto right_q = read_data_binary<uint64_t>(files[1], false);
+    if (left_q.empty() || left_q.size() != right_q.size())
+        throw std::runtime_error("error, queries files are empty or mismatched.");
+
+    std::vector<std::pair<uint64_t, uint64_t>> queries(left_q.size());
+    for (size_t i = 0; i < left_q.size(); i++)
+        queries[i] = {left_q[i], right_q[i]};
+
+    auto bpk = parser.get<double>("budget");
+    auto budget = (uint64_t) std::ceil(bpk * keys.size() / 8);
+    std::cout << "[+] nkeys=" << keys.size() << ", nqueries=" << queries.size() << ", budget=" << budget << " bytes" << std::endl;
+
+    auto start = timer::now();
+    grafite::tuner t(keys.begin(), keys.end(), queries.begin(), queries.end(), parser.get<int>("--max-queries"));
+    t.L_quantile = parser.get<double>("--L-quantile");
+    t.max_sample_keys = std::max(1, parser.get<int>("--max-sample-keys"));
+    t.confirm_build = !parser.get<bool>("--no-confirm");
+    auto res = t.tune(budget);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(timer::now() - start).count();
+
+    std::cout << "[+] tuning completed in " << elapsed << "ms (" << res.trial_builds << " trial builds"
+              << (res.confirmed ? ", recommended filter measured" : "") << ")" << std::endl;
+    if (std::isinf(res.filter_bpk))
+        std::cout << "[+] grafite: skipped, the budget leaves no bits per key over the Elias-Fano overhead" << std::endl;
+    else
+        std::cout << "[+] grafite: bpk=" << res.filter_bpk << ", sample fpr=" << res.filter_fpr << std::endl;
+    std::cout << "[+] bucket: bpk=" << res.bucket_bpk << ", sample fpr=" << res.bucket_fpr << std::endl;
+    if (res.kind == grafite::filter_kind::grafite)
+        std::cout << "[+] recommended: grafite::filter(begin, end, eps=" << res.eps << ", L=" << res.L
+                  << ") or grafite::filter(begin, end, bpk=" << res.bpk << ")" << std::endl;
+    else
+        std::cout << "[+] recommended: grafite::bucket(begin, end, bpk=" << res.bpk << ")" << std::endl;
+
+    return 0;
+}
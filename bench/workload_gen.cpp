@@ -16,15 +16,22 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <atomic>
 #include <cassert>
+#include <functional>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #include "bench_utils.hpp"
 #include <argparse/argparse.hpp>
 
-static const std::vector<std::string> kdist_names = {"kuniform", "knormal"};
+static const std::vector<std::string> kdist_names = {"kuniform", "knormal", "ktimeseries", "kclustered"};
 static const std::vector<std::string> kdist_default = {"kuniform"};
-static const std::vector<std::string> qdist_names = {"quniform", "qnormal", "qcorrelated", "qtrue"};
+static const std::vector<std::string> qdist_names = {"quniform", "qnormal", "qcorrelated", "qtrue", "qzipf", "qadversarial"};
 static const std::vector<std::string> qdist_default = {"quniform", "qcorrelated"};
 
 auto s = 10999;
@@ -32,9 +39,16 @@ auto s = 10999;
 // std::random_device rd;
 // #define seed rd()
 
+unsigned n_threads = std::max(1u, std::thread::hardware_concurrency());
+
 bool save_binary = true;
 bool allow_true_queries = false;
 bool mixed_queries = false;
+bool sort_queries = true; /* if the queries are written sorted, as in the baseline workloads, or in generation order */
+double zipf_theta = 0.99;
+int n_clusters = 16;
+double adv_bpk = 16; /* the bits per key of the filter targeted by qadversarial */
+bool adv_pow2 = false; /* if the filter targeted by qadversarial rounds its reduced universe to a power of two */
 
 auto default_n_keys = 200'000'000;
 auto default_n_queries = 10'000'000;
@@ -54,30 +68,175 @@ void save_keys(InputKeys<uint64_t> &keys, const std::string &file)
         save_keys_to_file(keys, file + ".txt");
 }
 
-void save_queries(Workload<uint64_t> &work, const std::string &l_keys, const std::string &r_keys = "", const std::string &res_keys = "")
-{
-    if (save_binary)
-    {
-        std::vector<uint64_t> left_q, right_q;
-        std::vector<int> result_q;
-        left_q.reserve(work.size());
-        right_q.reserve(work.size());
-        result_q.reserve(work.size());
-        for (auto w : work)
-        {
-            auto [left, right, result] = w;
-            left_q.push_back(left);
-            right_q.push_back(right);
-            result_q.push_back(result);
+/**
+ * Writes the queries to the files of a workload: the binary left, right and result files in the format of
+ * write_to_binary_file, whose number of elements is written by close(), or the text left and right files if save_binary
+ * is not set. The files with an empty name are not written.
+ *
+ * If sort_queries is set, the queries are written sorted by (left, right), as in the baseline workloads, with an
+ * external sort: they are buffered in runs of run_size queries, each run is sorted and spilled to a temporary file
+ * next to the left file, and close() merges the runs into the output files. Otherwise they are written as they are
+ * generated, without keeping them in memory.
+ */
+class QueryWriter {
+    using query_type = std::tuple<uint64_t, uint64_t, int>;
+    static constexpr size_t run_size = 1 << 20;
+
+    std::ofstream left_file, right_file, result_file;
+    std::string run_prefix;
+    std::vector<query_type> run;
+    std::vector<std::string> run_names;
+    uint64_t n = 0;
+
+    template <typename T>
+    static void write_value(std::ofstream &file, const T value) {
+        if (file.is_open())
+            file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    static void open(std::ofstream &file, const std::string &name) {
+        if (name.empty())
+            return;
+        if (save_binary)
+            file.open(name, std::ios::out | std::ios::trunc | std::ios::binary);
+        else
+            file.open(name + ".txt", std::ios::out | std::ios::trunc);
+        if (!file)
+            throw std::runtime_error("error, impossible to write " + name);
+    }
+
+    /**
+     * Writes the number of elements at the beginning of the binary 'file', as an element of type T.
+     */
+    template <typename T>
+    void write_size(std::ofstream &file) {
+        if (!file.is_open())
+            return;
+        file.seekp(0);
+        write_value(file, T(n));
+    }
+
+    void write(const uint64_t left, const uint64_t right, const int result) {
+        if (save_binary) {
+            write_value(left_file, left);
+            write_value(right_file, right);
+            write_value(result_file, result);
+        } else {
+            left_file << left << "\n";
+            if (right_file.is_open())
+                right_file << right << "\n";
         }
-        write_to_binary_file(left_q, l_keys);
-        if (!r_keys.empty())
-            write_to_binary_file(right_q, r_keys);
+    }
 
-        write_to_binary_file(result_q, res_keys);
+    /**
+     * Sorts the buffered run and spills it to a new temporary file.
+     */
+    void spill_run() {
+        std::sort(run.begin(), run.end());
+        auto name = run_prefix + ".run" + std::to_string(run_names.size());
+        std::ofstream file(name, std::ios::out | std::ios::trunc | std::ios::binary);
+        file.write(reinterpret_cast<const char *>(run.data()), run.size() * sizeof(query_type));
+        if (!file)
+            throw std::runtime_error("error, impossible to write " + name);
+        run_names.push_back(name);
+        run.clear();
     }
-    else
-        save_workload_to_file(work, l_keys + ".txt", r_keys + ".txt");
+
+    /**
+     * Writes the buffered queries sorted, merging the spilled runs with a heap of their smallest unread queries and
+     * removing their files.
+     */
+    void write_sorted() {
+        if (run_names.empty()) {
+            std::sort(run.begin(), run.end());
+            for (const auto &[left, right, result] : run)
+                write(left, right, result);
+            run = std::vector<query_type>();
+            return;
+        }
+        if (!run.empty())
+            spill_run();
+        run.shrink_to_fit();
+
+        using head_type = std::pair<query_type, size_t>;
+        std::priority_queue<head_type, std::vector<head_type>, std::greater<>> heads;
+        std::vector<std::ifstream> runs;
+        auto read_next = [&](size_t r) {
+            query_type q;
+            if (runs[r].read(reinterpret_cast<char *>(&q), sizeof(query_type)))
+                heads.emplace(q, r);
+        };
+        for (size_t r = 0; r < run_names.size(); ++r) {
+            runs.emplace_back(run_names[r], std::ios::in | std::ios::binary);
+            if (!runs.back())
+                throw std::runtime_error("error, impossible to read " + run_names[r]);
+            read_next(r);
+        }
+        while (!heads.empty()) {
+            auto [q, r] = heads.top();
+            heads.pop();
+            write(std::get<0>(q), std::get<1>(q), std::get<2>(q));
+            read_next(r);
+        }
+
+        runs.clear();
+        for (const auto &name : run_names)
+            std::filesystem::remove(name);
+        run_names.clear();
+    }
+
+public:
+    QueryWriter(const std::string &l_keys, const std::string &r_keys = "", const std::string &res_keys = "")
+            : run_prefix(l_keys) {
+        open(left_file, l_keys);
+        open(right_file, r_keys);
+        if (save_binary) {
+            open(result_file, res_keys);
+            write_size<uint64_t>(left_file);
+            write_size<uint64_t>(right_file);
+            write_size<int>(result_file);
+        }
+    }
+
+    void add(const uint64_t left, const uint64_t right, const bool result) {
+        if (sort_queries) {
+            run.emplace_back(left, right, int(result));
+            if (run.size() == run_size)
+                spill_run();
+        } else
+            write(left, right, int(result));
+        ++n;
+    }
+
+    uint64_t size() const {
+        return n;
+    }
+
+    void close() {
+        if (sort_queries)
+            write_sorted();
+        if (save_binary) {
+            write_size<uint64_t>(left_file);
+            write_size<uint64_t>(right_file);
+            write_size<int>(result_file);
+        }
+        for (auto *file : {&left_file, &right_file, &result_file}) {
+            if (!file->is_open())
+                continue;
+            file->close();
+            if (!*file)
+                throw std::runtime_error("error, impossible to write the queries");
+        }
+    }
+};
+
+/**
+ * Opens the writer of the queries in the directory 'queries_path': the point file if 'point' is set, the left and
+ * right files otherwise, plus the result file if the true queries are allowed.
+ */
+QueryWriter open_queries(const std::string &queries_path, const bool point) {
+    return QueryWriter(queries_path + (point ? "point" : "left"), point ? "" : queries_path + "right",
+                       allow_true_queries ? queries_path + "result" : "");
 }
 
 /**
@@ -112,111 +271,317 @@ bool create_dir_recursive(const std::string &dir_name) {
     return true;
 }
 
-InputKeys<uint64_t> generate_keys_uniform(uint64_t n_keys, uint64_t max_key = UINT64_MAX - 1) {
-    std::set<uint64_t> keys_set;
+/**
+ * Runs f(0), ..., f(n_tasks - 1) on up to 'n_threads' threads, the calling one included.
+ */
+void parallel_for(size_t n_tasks, const std::function<void(size_t)> &f) {
+    std::atomic<size_t> next_task{0};
+    auto work = [&] {
+        for (size_t t; (t = next_task.fetch_add(1)) < n_tasks;)
+            f(t);
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min<size_t>(n_threads, n_tasks); ++i)
+        workers.emplace_back(work);
+    work();
+    for (auto &w : workers)
+        w.join();
+}
 
-    std::mt19937 gen(seed);
-    std::uniform_int_distribution<uint64_t> distr_value(0, max_key);
+/**
+ * Sorts [begin, end) by sorting 'n_threads' blocks in parallel and then merging them pairwise, in parallel, in
+ * log2(n_threads) rounds.
+ */
+template <typename RandomIt>
+void parallel_sort(RandomIt begin, RandomIt end) {
+    const size_t n = std::distance(begin, end);
+    const size_t n_blocks = std::max<size_t>(1, std::min<size_t>(n_threads, n >> 16));
+    std::vector<size_t> bounds(n_blocks + 1);
+    for (size_t b = 0; b <= n_blocks; ++b)
+        bounds[b] = (b * n) / n_blocks;
+
+    parallel_for(n_blocks, [&](size_t b) { std::sort(begin + bounds[b], begin + bounds[b + 1]); });
+    for (size_t width = 1; width < n_blocks; width *= 2)
+        parallel_for((n_blocks + 2 * width - 1) / (2 * width), [&](size_t m) {
+            auto lo = 2 * m * width, mid = std::min(lo + width, n_blocks), hi = std::min(lo + 2 * width, n_blocks);
+            std::inplace_merge(begin + bounds[lo], begin + bounds[mid], begin + bounds[hi]);
+        });
+}
 
-    auto n_iterations = 0;
-    while (keys_set.size() < n_keys) {
-        if (++n_iterations >= 10 * n_keys)
+/**
+ * Generates 'n_keys' unique keys drawn from 'distr', sorted. The keys are drawn in parallel in fixed-size chunks, each
+ * with its own engine seeded by 'base_seed' and the index of the chunk, then they are sorted and deduplicated, and the
+ * missing keys are drawn from the next chunks until 'n_keys' unique keys exist. Thus, the output depends only on
+ * 'base_seed', and not on the number of threads.
+ */
+template <typename Distribution>
+InputKeys<uint64_t> generate_unique_keys(uint64_t n_keys, uint64_t base_seed, const Distribution &distr) {
+    constexpr uint64_t chunk_size = 1 << 20;
+
+    InputKeys<uint64_t> keys;
+    uint64_t next_chunk = 0, n_drawn = 0;
+    while (keys.size() < n_keys) {
+        const auto n_unique = keys.size(), n_missing = n_keys - n_unique;
+        if ((n_drawn += n_missing) > 10 * n_keys)
             throw std::runtime_error("error: timeout for the input keys generation");
 
-        auto key = distr_value(gen);
-        keys_set.insert(key);
-        printProgress(((double) keys_set.size()) / n_keys);
+        keys.resize(n_keys);
+        const auto n_chunks = (n_missing + chunk_size - 1) / chunk_size;
+        parallel_for(n_chunks, [&](size_t c) {
+            const auto chunk = next_chunk + c;
+            std::seed_seq seq{uint32_t(base_seed), uint32_t(base_seed >> 32), uint32_t(chunk), uint32_t(chunk >> 32)};
+            std::mt19937_64 gen(seq);
+            auto d = distr;
+            const auto lo = n_unique + c * chunk_size, hi = std::min(n_keys, lo + chunk_size);
+            for (auto i = lo; i < hi; ++i)
+                keys[i] = static_cast<uint64_t>(d(gen));
+        });
+        next_chunk += n_chunks;
+
+        parallel_sort(keys.begin() + n_unique, keys.end());
+        std::inplace_merge(keys.begin(), keys.begin() + n_unique, keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        printProgress(((double) keys.size()) / n_keys);
     }
 
-    return {keys_set.begin(), keys_set.end()};
+    return keys;
+}
+
+InputKeys<uint64_t> generate_keys_uniform(uint64_t n_keys, uint64_t max_key = UINT64_MAX - 1) {
+    return generate_unique_keys(n_keys, seed, std::uniform_int_distribution<uint64_t>(0, max_key));
 }
 
 InputKeys<uint64_t> generate_keys_normal(uint64_t n_keys, long double sd) {
-    std::set<uint64_t> keys_set;
+    return generate_unique_keys(n_keys, seed, std::normal_distribution<long double>(1ULL << (64 - 1), sd));
+}
 
-    std::mt19937 gen(seed);
-    auto nor_dist = std::normal_distribution<long double>(1ULL << (64 - 1), sd);
+/**
+ * Computes the ground truth of the ranges [left, right] against the sorted 'keys', i.e. whether each range contains at
+ * least one key (a point query is a range with left == right). The ranges are sorted by their left endpoint and swept
+ * against the keys in a single merge pass, split across the threads, each starting from the lower bound of the first
+ * range of its part.
+ */
+std::vector<uint8_t> range_ground_truth(const InputKeys<uint64_t> &keys,
+                                        const std::vector<std::pair<uint64_t, uint64_t>> &ranges) {
+    std::vector<std::pair<uint64_t, size_t>> sorted_lefts(ranges.size());
+    for (size_t i = 0; i < ranges.size(); ++i)
+        sorted_lefts[i] = {ranges[i].first, i};
+    parallel_sort(sorted_lefts.begin(), sorted_lefts.end());
+
+    std::vector<uint8_t> results(ranges.size());
+    const size_t n_parts = std::max<size_t>(1, std::min<size_t>(n_threads, ranges.size() >> 16));
+    parallel_for(n_parts, [&](size_t p) {
+        const auto lo = (p * ranges.size()) / n_parts, hi = ((p + 1) * ranges.size()) / n_parts;
+        if (lo == hi)
+            return;
+        auto it = std::lower_bound(keys.begin(), keys.end(), sorted_lefts[lo].first);
+        for (auto j = lo; j < hi; ++j) {
+            const auto [left, i] = sorted_lefts[j];
+            while (it != keys.end() && *it < left)
+                ++it;
+            results[i] = (it != keys.end() && *it <= ranges[i].second);
+        }
+    });
+    return results;
+}
 
-    auto n_iterations = 0;
-    while (keys_set.size() < n_keys) {
-        if (++n_iterations >= 10 * n_keys)
-            throw std::runtime_error("error: timeout for the input keys generation");
+/**
+ * Generates 'n_keys' monotone timestamps with bursty gaps. The gaps alternate between bursts of small gaps and idle
+ * periods of gaps 1000 times larger, switching state with probability 1% after each key (a two-state Markov chain),
+ * and the keys span about 2^61. The gaps are drawn in parallel in fixed-size chunks, each with its own engine as in
+ * generate_unique_keys, and then prefix-summed chunk by chunk, thus the keys depend only on the seed.
+ */
+InputKeys<uint64_t> generate_keys_timeseries(uint64_t n_keys) {
+    constexpr uint64_t chunk_size = 1 << 20;
+    constexpr double burst_ratio = 1000, switch_prob = 0.01;
+    const uint64_t base_seed = seed;
+    const double idle_gap = std::exp2(62) / n_keys;
+
+    InputKeys<uint64_t> keys(n_keys);
+    const auto n_chunks = (n_keys + chunk_size - 1) / chunk_size;
+    std::vector<uint64_t> chunk_offset(n_chunks + 1, 0);
+    parallel_for(n_chunks, [&](size_t c) {
+        std::seed_seq seq{uint32_t(base_seed), uint32_t(base_seed >> 32), uint32_t(c), uint32_t(c >> 32)};
+        std::mt19937_64 gen(seq);
+        std::exponential_distribution<double> idle(1 / idle_gap), burst(burst_ratio / idle_gap);
+        std::bernoulli_distribution switch_state(switch_prob);
+
+        bool bursty = false;
+        uint64_t sum = 0;
+        for (auto i = c * chunk_size; i < std::min(n_keys, (c + 1) * chunk_size); ++i) {
+            if (switch_state(gen))
+                bursty = !bursty;
+            sum += 1 + static_cast<uint64_t>(bursty ? burst(gen) : idle(gen));
+            keys[i] = sum;
+        }
+        chunk_offset[c + 1] = sum;
+    });
+
+    for (size_t c = 1; c <= n_chunks; ++c)
+        if (__builtin_add_overflow(chunk_offset[c], chunk_offset[c - 1], &chunk_offset[c]))
+            throw std::runtime_error("error: the time-series keys overflow the universe");
+    parallel_for(n_chunks, [&](size_t c) {
+        for (auto i = c * chunk_size; i < std::min(n_keys, (c + 1) * chunk_size); ++i)
+            keys[i] += chunk_offset[c];
+    });
+
+    printProgress(1);
+    return keys;
+}
 
-        auto key = nor_dist(gen);
-        keys_set.insert(key);
-        printProgress(((double) keys_set.size()) / n_keys);
+/**
+ * The multi-modal distribution of the kclustered keys: each key is drawn from one of the normal distributions
+ * centered in 'centers', picked uniformly, and clamped to the universe.
+ */
+struct clustered_distribution {
+    std::vector<long double> centers;
+    long double sd;
+
+    template <typename Gen>
+    uint64_t operator()(Gen &gen) {
+        auto center = centers[std::uniform_int_distribution<size_t>(0, centers.size() - 1)(gen)];
+        auto x = std::normal_distribution<long double>(center, sd)(gen);
+        return (x <= 0) ? 0 : (x >= (long double) (UINT64_MAX - 1)) ? UINT64_MAX - 1 : static_cast<uint64_t>(x);
     }
+};
+
+InputKeys<uint64_t> generate_keys_clustered(uint64_t n_keys) {
+    std::mt19937_64 gen(seed);
+    std::uniform_real_distribution<long double> center_distr(0, (long double) UINT64_MAX);
+    clustered_distribution distr{std::vector<long double>(n_clusters), std::exp2l(64) / (64 * n_clusters)};
+    for (auto &c : distr.centers)
+        c = center_distr(gen);
+    return generate_unique_keys(n_keys, seed, distr);
+}
 
-    return {keys_set.begin(), keys_set.end()};
+InputKeys<uint64_t> generate_keys(const std::string &kdist, uint64_t n_keys, const long double stddev) {
+    if (kdist == "kuniform")
+        return generate_keys_uniform(n_keys);
+    else if (kdist == "knormal")
+        return generate_keys_normal(n_keys, stddev);
+    else if (kdist == "ktimeseries")
+        return generate_keys_timeseries(n_keys);
+    else // kdist == "kclustered"
+        return generate_keys_clustered(n_keys);
 }
 
-Workload<uint64_t> generate_true_queries(InputKeys<uint64_t> &keys,uint64_t n_queries, uint64_t range_size, bool mixed = false)
+/**
+ * The Zipfian distribution over the ranks [0, n) with exponent 'theta' in (0, 1), where the rank 0 is the most
+ * frequent. Each rank is drawn in constant time, after computing the zeta constant in O(n), as in YCSB (see Gray et
+ * al., "Quickly generating billion-record synthetic databases", SIGMOD 1994).
+ */
+class zipf_distribution {
+    uint64_t n;
+    double theta, alpha, zetan, eta;
+
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i)
+            sum += 1 / std::pow((double) i, theta);
+        return sum;
+    }
+
+public:
+    zipf_distribution(uint64_t n, double theta) : n(n), theta(theta), alpha(1 / (1 - theta)), zetan(zeta(n, theta)) {
+        eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / zetan);
+    }
+
+    template <typename Gen>
+    uint64_t operator()(Gen &gen) {
+        auto u = std::uniform_real_distribution<double>(0, 1)(gen);
+        auto uz = u * zetan;
+        if (uz < 1)
+            return 0;
+        if (uz < 1 + std::pow(0.5, theta))
+            return 1;
+        return std::min<uint64_t>(n - 1, static_cast<uint64_t>(n * std::pow(eta * u - eta + 1, alpha)));
+    }
+};
+
+/**
+ * Generates 'n_queries' true queries, each containing a distinct key at a random offset, and writes them to 'out' in
+ * the order of the keys. The keys are picked by selection sampling (Knuth's Algorithm S) in a single pass.
+ */
+void generate_true_queries(InputKeys<uint64_t> &keys, uint64_t n_queries, uint64_t range_size, QueryWriter &out,
+                           bool mixed = false)
 {
-    std::set<uint64_t> chosen_points;
+    if (n_queries > keys.size())
+        throw std::runtime_error("error, there are less keys than true queries");
 
     std::mt19937 gen_random_keys(seed);
-    std::uniform_int_distribution<uint64_t> rand_keys_distr(0, keys.size() - 1);
+    std::uniform_real_distribution<double> rand_keys_distr(0, 1);
 
     std::mt19937 gen_random_offset(seed);
     std::uniform_int_distribution<uint64_t> rand_offset_distr(0, range_size - 1);
 
-    while (chosen_points.size() != n_queries)
-        chosen_points.insert(keys[rand_keys_distr(gen_random_keys)]);
-
-    Workload<uint64_t> w;
-    w.reserve(n_queries);
-
     std::mt19937 gen_range(seed);
     auto left_pow = 0, right_pow = static_cast<int>(std::floor(std::log2(range_size)));
     std::uniform_int_distribution<uint64_t> range_distr(left_pow, right_pow);
 
-    for (auto point : chosen_points)
+    for (size_t i = 0; i < keys.size() && out.size() < n_queries; ++i)
     {
+        if ((keys.size() - i) * rand_keys_distr(gen_random_keys) >= n_queries - out.size())
+            continue;
+
+        auto point = keys[i];
+        auto r = range_size;
         if (mixed)
         {
-            auto r = static_cast<uint64_t>(std::exp2(range_distr(gen_range)));
+            r = static_cast<uint64_t>(std::exp2(range_distr(gen_range)));
             std::uniform_int_distribution<uint64_t>::param_type d(0, r - 1);
             rand_offset_distr.param(d);
-            auto [left, right] = point_to_range(point - rand_offset_distr(gen_random_offset), r);
-            w.emplace_back(left, right, true);
         }
-        else
-        {
-            auto [left, right] = point_to_range(point - rand_offset_distr(gen_random_offset), range_size);
-            w.emplace_back(left, right, true);
-        }
-
+        auto [left, right] = point_to_range(point - std::min(point, rand_offset_distr(gen_random_offset)), r);
+        out.add(left, right, true);
+        printProgress(((double) out.size()) / n_queries);
     }
-
-    return w;
 }
 
 
-Workload<uint64_t> generate_synth_queries(const std::string& qdist, InputKeys<uint64_t> &keys,
-                                          uint64_t n_queries, uint64_t min_range, uint64_t max_range,
-                                          const double corr_degree, const long double stddev) {
-    std::set<std::tuple<uint64_t, uint64_t, bool>> q;
+/**
+ * Returns a 64-bit fingerprint of the query [left, right], mixing the endpoints with the finalizer of splitmix64.
+ */
+uint64_t query_fingerprint(const uint64_t left, const uint64_t right) {
+    auto x = left ^ (right * 0x9e3779b97f4a7c15ULL);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
 
-    std::vector<uint64_t> middle_points;
+/**
+ * Generates 'n_queries' unique queries of the distribution 'qdist' and passes them to 'out' in generation order, which
+ * sorts them unless sort_queries is unset. The candidate queries are generated in rounds of at most 2^20, one per
+ * missing query, and their ground truth is computed in bulk by range_ground_truth; the first unique candidates which
+ * are accepted are written. The only state kept across the rounds is the sorted list of the 64-bit fingerprints of the
+ * written queries, used to discard the duplicates (a collision of two fingerprints discards a unique candidate, which
+ * is then replaced by the next rounds).
+ */
+void generate_synth_queries(const std::string& qdist, InputKeys<uint64_t> &keys,
+                            uint64_t n_queries, uint64_t min_range, uint64_t max_range,
+                            const double corr_degree, const long double stddev, QueryWriter &out) {
+    constexpr uint64_t round_size = 1 << 20;
 
-    if (qdist == "qnormal")
-        middle_points = generate_keys_normal(10 * n_queries, stddev);
-    else if (qdist == "quniform")
-        middle_points = generate_keys_uniform(3 * n_queries);
-    else // qdist == "qcorrelated"
+    std::vector<uint64_t> hot_spots, shuffled_keys;
+    if (qdist == "qzipf")
     {
+        /* the hot spots, shuffled so that their rank does not depend on their position */
+        hot_spots = generate_keys_uniform(std::max<uint64_t>(2, n_queries / 64));
         std::mt19937 g(seed);
-        auto t = keys;
-        std::shuffle(t.begin(), t.end(), g);
-        auto i = 0;
-        middle_points.reserve(n_queries);
-        while (i < n_queries) {
-            auto n = std::min<uint64_t>(keys.size(), n_queries - i);
-            std::copy(t.begin() + i, t.begin() + i + n, middle_points.begin() + i);
-            i += n;
-        }
+        std::shuffle(hot_spots.begin(), hot_spots.end(), g);
+    }
+    else if (qdist == "qcorrelated")
+    {
+        std::mt19937 g(seed);
+        shuffled_keys = keys;
+        std::shuffle(shuffled_keys.begin(), shuffled_keys.end(), g);
     }
 
+    /* the left endpoints of quniform and qnormal, drawn as the keys of kuniform and knormal */
+    std::mt19937_64 gen_middle(seed);
+    std::uniform_int_distribution<uint64_t> uniform_distr(0, UINT64_MAX - 1);
+    std::normal_distribution<long double> normal_distr(1ULL << (64 - 1), stddev);
+
     std::mt19937 gen_range(seed);
     auto left_pow = (min_range) ? static_cast<int>(std::floor(std::log2(min_range))) : 0, right_pow = static_cast<int>(std::floor(std::log2(max_range)));
     std::uniform_int_distribution<uint64_t> range_distr(left_pow, right_pow);
@@ -224,16 +589,60 @@ Workload<uint64_t> generate_synth_queries(const std::string& qdist, InputKeys<ui
     std::mt19937 gen_corr(seed);
     std::uniform_int_distribution<uint64_t> corr_distr(1, (1UL << std::lround(30 * (1 - corr_degree))));
 
-    std::mt19937 gen_pos_middle_points(seed);
-    std::uniform_int_distribution<int> pos_distr(1, middle_points.size() - 1);
-    auto n_iterations = 0;
-    auto i = 0;
-    while (q.size() < n_queries) {
-        if (++n_iterations >= 100 * n_queries) {
+    /*
+     * The queries of 'qzipf' fall in a window of 1024 times the maximum range size after a hot spot, picked with the
+     * Zipfian distribution.
+     */
+    std::mt19937 gen_hot(seed);
+    std::optional<zipf_distribution> hot_distr;
+    if (qdist == "qzipf")
+        hot_distr.emplace(hot_spots.size(), zipf_theta);
+    const auto hot_window = (max_range > (UINT64_MAX >> 10)) ? UINT64_MAX : max_range * 1024 - 1;
+    std::uniform_int_distribution<uint64_t> hot_offset_distr(0, hot_window);
+
+    /*
+     * The queries of 'qadversarial' target the hash 'h(x) = (g(x / r) + x) mod r' of a filter with 'adv_bpk' bits per
+     * key, i.e. with a reduced universe of size 'r = n * 2^(adv_bpk - 2)', around a random key 'x'. Each query is one of:
+     *  - adjacent: right before or after 'x', at a distance whose log2 is uniform in [0, log2(4 * average gap)], as
+     *    the ranges close to the keys map close to their hashes;
+     *  - alias: covering 'x + j * r' for a random j in [-64, 64] \ {0}, which has the offset 'x mod r' of 'x' in another
+     *    block and thus the same hash whenever 'g' collides on the two blocks;
+     *  - boundary: straddling the first or the last position of the block of 'x', which is mapped to two ranges.
+     */
+    const auto adv_r_nominal = std::ceil(keys.size() * std::exp2(adv_bpk - 2));
+    if (qdist == "qadversarial" && adv_r_nominal >= std::exp2(63))
+        throw std::runtime_error("error, the reduced universe of qadversarial overflows");
+    auto adv_r = std::max<uint64_t>(1, (uint64_t) adv_r_nominal);
+    if (adv_pow2)
+        adv_r = uint64_t(1) << (64 - __builtin_clzll(std::max<uint64_t>(2, adv_r) - 1));
+    std::mt19937 gen_adv(seed);
+    std::uniform_int_distribution<size_t> adv_key_distr(0, keys.size() - 1);
+    auto average_gap = std::max<long double>(1, (long double) (keys.back() - keys.front()) / keys.size());
+    std::uniform_real_distribution<double> adv_distance_distr(0, std::log2(4 * average_gap));
+    std::uniform_int_distribution<int> adv_kind_distr(0, 2), adv_alias_distr(1, 64);
+    std::uniform_int_distribution<uint64_t> adv_offset_distr;
+    std::bernoulli_distribution adv_side_distr(0.5);
+    uint64_t n_iterations = 0;
+
+    /*
+     * Each candidate fills a slot, i.e. one of the missing queries, which stays open until one of its candidates is
+     * written. The candidates of the slot k of qcorrelated are drawn around the k-th shuffled key.
+     */
+    std::vector<uint64_t> slots;
+    std::vector<size_t> candidate_slot;
+    uint64_t next_slot = 0;
+    std::vector<std::pair<uint64_t, uint64_t>> candidates;
+    std::vector<uint64_t> fingerprints, written;
+    std::vector<size_t> accepted;
+    written.reserve(n_queries);
+    std::vector<uint8_t> keep;
+    while (out.size() < n_queries) {
+        if (n_iterations >= 100 * n_queries) {
             std::string in;
             std::cout << std::endl
                       << "application seems stuck, close it or save less query? (y/n/save) ";
-            std::cin >> in;
+            if (!(std::cin >> in))
+                throw std::runtime_error("error: timeout for the workload generation");
             if (in == "save")
                 break;
             else if (in == "y")
@@ -241,37 +650,115 @@ Workload<uint64_t> generate_synth_queries(const std::string& qdist, InputKeys<ui
             n_iterations = 0;
         }
 
-        auto range_size = (min_range == max_range) ? min_range : static_cast<uint64_t>(std::exp2(range_distr(gen_range)));
+        candidates.clear();
+        candidate_slot.clear();
+        while (slots.size() < std::min(round_size, n_queries - out.size()))
+            slots.push_back(next_slot++);
+        for (size_t j = 0; j < slots.size(); ++j, ++n_iterations) {
+            auto range_size = (min_range == max_range) ? min_range : static_cast<uint64_t>(std::exp2(range_distr(gen_range)));
 
-        uint64_t left, right;
+            uint64_t left, right;
 
-        if (qdist == "quniform")
-            std::tie(left, right) = point_to_range(middle_points[i++], range_size);
-        else if (qdist == "qnormal")
-            std::tie(left, right) = point_to_range(middle_points[pos_distr(gen_pos_middle_points)], range_size);
-        else // qdist == qcorrelated
-        {
-            auto p = middle_points[q.size()] + corr_distr(gen_corr);
-            std::tie(left, right) = point_to_range(p, range_size);
-        }
-        if (std::numeric_limits<uint64_t>::max() - left < range_size)
-            continue;
+            if (qdist == "quniform")
+                std::tie(left, right) = point_to_range(uniform_distr(gen_middle), range_size);
+            else if (qdist == "qnormal")
+            {
+                auto x = normal_distr(gen_middle);
+                if (x < 0 || x >= (long double) (UINT64_MAX - 1))
+                    continue;
+                std::tie(left, right) = point_to_range(static_cast<uint64_t>(x), range_size);
+            }
+            else if (qdist == "qzipf")
+            {
+                auto hot_spot = hot_spots[(*hot_distr)(gen_hot)];
+                auto offset = hot_offset_distr(gen_hot);
+                if (std::numeric_limits<uint64_t>::max() - hot_spot < offset)
+                    continue;
+                std::tie(left, right) = point_to_range(hot_spot + offset, range_size);
+            }
+            else if (qdist == "qadversarial")
+            {
+                auto key = keys[adv_key_distr(gen_adv)];
+                auto kind = adv_kind_distr(gen_adv);
+                auto after = adv_side_distr(gen_adv);
+                uint64_t target; /* the position covered by the query, at the offset 'target_offset' from its left */
+                auto target_offset = adv_offset_distr(gen_adv, decltype(adv_offset_distr)::param_type(0, range_size - 1));
+                if (kind == 0) /* adjacent */
+                {
+                    auto distance = static_cast<uint64_t>(std::exp2(adv_distance_distr(gen_adv)));
+                    if (after ? std::numeric_limits<uint64_t>::max() - key < distance : key < distance + range_size - 1)
+                        continue;
+                    target = after ? key + distance : key - distance;
+                    target_offset = after ? 0 : range_size - 1;
+                }
+                else if (kind == 1) /* alias */
+                {
+                    uint64_t shift;
+                    if (__builtin_mul_overflow(adv_r, (uint64_t) adv_alias_distr(gen_adv), &shift))
+                        continue;
+                    if (after ? std::numeric_limits<uint64_t>::max() - key < shift : key < shift)
+                        continue;
+                    target = after ? key + shift : key - shift;
+                }
+                else /* boundary */
+                {
+                    auto block_begin = (key / adv_r) * adv_r;
+                    if (!after && block_begin == 0)
+                        continue;
+                    if (after && std::numeric_limits<uint64_t>::max() - block_begin < adv_r)
+                        continue;
+                    target = after ? block_begin + adv_r : block_begin; /* the first position after the boundary */
+                    if (range_size == 1)
+                        target_offset = after ? 0 : 1; /* a point query on either side of the boundary */
+                    else
+                        target_offset = std::max<uint64_t>(1, target_offset);
+                }
+                if (target < target_offset)
+                    continue;
+                std::tie(left, right) = point_to_range(target - target_offset, range_size);
+            }
+            else // qdist == qcorrelated
+            {
+                auto p = shuffled_keys[slots[j] % shuffled_keys.size()] + corr_distr(gen_corr);
+                std::tie(left, right) = point_to_range(p, range_size);
+            }
+            if (std::numeric_limits<uint64_t>::max() - left < range_size)
+                continue;
 
-        auto q_result = (range_size > 1) ? vector_range_query(keys, left, right) : vector_point_query(keys, left);
-        if (!allow_true_queries && q_result)
-            continue;
+            candidates.emplace_back(left, right);
+            candidate_slot.push_back(j);
+        }
 
-        q.emplace(left, right, q_result);
-        printProgress(((double) q.size()) / n_queries);
+        /*
+         * Keeps the first occurrence of each accepted candidate of the round, unless it was written by a previous
+         * round, and writes the kept ones in generation order.
+         */
+        auto results = range_ground_truth(keys, candidates);
+        accepted.clear();
+        fingerprints.resize(candidates.size());
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            fingerprints[c] = query_fingerprint(candidates[c].first, candidates[c].second);
+            if (allow_true_queries || !results[c])
+                accepted.push_back(c);
+        }
+        std::stable_sort(accepted.begin(), accepted.end(), [&](size_t a, size_t b) { return fingerprints[a] < fingerprints[b]; });
+        keep.assign(candidates.size(), false);
+        for (size_t k = 0; k < accepted.size(); ++k)
+            keep[accepted[k]] = (k == 0 || fingerprints[accepted[k]] != fingerprints[accepted[k - 1]])
+                                && !std::binary_search(written.begin(), written.end(), fingerprints[accepted[k]]);
+
+        const auto n_written = written.size();
+        for (size_t c = 0; c < candidates.size() && out.size() < n_queries; ++c)
+            if (keep[c]) {
+                out.add(candidates[c].first, candidates[c].second, results[c]);
+                written.push_back(fingerprints[c]);
+                slots[candidate_slot[c]] = UINT64_MAX; /* closes the slot */
+            }
+        slots.erase(std::remove(slots.begin(), slots.end(), UINT64_MAX), slots.end());
+        std::sort(written.begin() + n_written, written.end());
+        std::inplace_merge(written.begin(), written.begin() + n_written, written.end());
+        printProgress(((double) out.size()) / n_queries);
     }
-
-    return {q.begin(), q.end()};
-}
-
-Workload<uint64_t> generate_synth_queries(const std::string& qdist, InputKeys<uint64_t> &keys,
-                                          uint64_t n_queries, uint64_t range_size,
-                                          const double corr_degree, const long double stddev) {
-    return generate_synth_queries(qdist, keys, n_queries, range_size, range_size, corr_degree, stddev);
 }
 
 void generate_synth_datasets(const std::vector<std::string> &kdist, const std::vector<std::string> &qdist,
@@ -296,28 +783,24 @@ void generate_synth_datasets(const std::vector<std::string> &kdist, const std::v
 
     for (const auto& k: kdist) {
         std::string root_path = "./" + k + "/";
-        auto keys = (k == "kuniform") ? generate_keys_uniform(n_keys) : generate_keys_normal(n_keys, stddev);
+        auto keys = generate_keys(k, n_keys, stddev);
         std::cout << std::endl
                   << "[+] generated `" << k << "` keys" << std::endl;
         for (const auto& q: qdist) {
-            for (auto i = 0; i < ranges.size(); i++) {
+            for (size_t i = 0; i < ranges.size(); i++) {
                 auto range_size = ranges[i];
-                auto queries = (q == "qtrue") ? generate_true_queries(keys, n_queries, range_size) :
-                        generate_synth_queries(q, keys, n_queries, range_size, range_size, corr_degree, stddev);
-                std::cout << std::endl
-                          << "[+] generated `" << q << "_" << range_size_list[i] << "` queries" << std::endl;
                 std::string queries_path = root_path + std::to_string(range_size_list[i]) + "_" + q + "/";
                 if (!create_dir_recursive(queries_path))
                     throw std::runtime_error("error, impossible to create dir");
 
-                if (allow_true_queries && range_size == 1)
-                    save_queries(queries, queries_path + "point", "",queries_path + "result");
-                else if (allow_true_queries)
-                    save_queries(queries, queries_path + "left", queries_path + "right", queries_path + "result");
-                else if (range_size == 1)
-                    save_queries(queries, queries_path + "point");
+                auto out = open_queries(queries_path, range_size == 1);
+                if (q == "qtrue")
+                    generate_true_queries(keys, n_queries, range_size, out);
                 else
-                    save_queries(queries, queries_path + "left", queries_path + "right");
+                    generate_synth_queries(q, keys, n_queries, range_size, range_size, corr_degree, stddev, out);
+                out.close();
+                std::cout << std::endl
+                          << "[+] generated `" << q << "_" << range_size_list[i] << "` queries" << std::endl;
                 std::cout << "[+] queries wrote at " << queries_path << std::endl;
             }
 
@@ -326,17 +809,16 @@ void generate_synth_datasets(const std::vector<std::string> &kdist, const std::v
                 auto range_size = ranges.back();
                 auto range_size_min = 1;
 
-                auto queries = (q == "qtrue") ? generate_true_queries(keys, n_queries, range_size, true) :
-                               generate_synth_queries(q, keys, n_queries, range_size_min, range_size, corr_degree, stddev);
-
                 auto queries_path = root_path + std::to_string(range_size_list.back()) + "M_" + q + "/"; /* mixed */
                 if (!create_dir_recursive(queries_path))
                     throw std::runtime_error("error, impossible to create dir");
 
-                if (allow_true_queries)
-                    save_queries(queries, queries_path + "left", queries_path + "right", queries_path + "result");
+                auto out = open_queries(queries_path, false);
+                if (q == "qtrue")
+                    generate_true_queries(keys, n_queries, range_size, out, true);
                 else
-                    save_queries(queries, queries_path + "left", queries_path + "right");
+                    generate_synth_queries(q, keys, n_queries, range_size_min, range_size, corr_degree, stddev, out);
+                out.close();
 
                 std::cout << std::endl << "[+] queries wrote at " << queries_path << std::endl;
             }
@@ -347,12 +829,14 @@ void generate_synth_datasets(const std::vector<std::string> &kdist, const std::v
     }
 }
 
-std::pair<InputKeys<uint64_t>, std::vector<Workload<uint64_t>>>
+/**
+ * Removes 'n_queries' keys from 'data', each followed by a gap larger than the maximum range size, and returns the
+ * remaining keys and the removed ones, in random order, as the left endpoints of the (empty) queries.
+ */
+std::pair<InputKeys<uint64_t>, std::vector<uint64_t>>
 generate_real_queries(std::vector<uint64_t> &data, uint64_t n_queries, std::vector<uint64_t> &range_list, bool remove_duplicates = true) {
     std::vector<std::pair<uint64_t, int>> candidates;
 
-    std::vector<Workload<uint64_t>> queries_list((mixed_queries) ? range_list.size() + 1 : range_list.size());
-
     auto max_range_size = *std::max_element(range_list.begin(), range_list.end());
 
     for (size_t i = 0; i < data.size() - 1; i++) {
@@ -401,28 +885,35 @@ generate_real_queries(std::vector<uint64_t> &data, uint64_t n_queries, std::vect
     if (!std::is_sorted(keys.begin(), keys.end()))
         throw std::runtime_error("unexpected error, keys are not sorted.");
 
+    std::vector<uint64_t> points(n_queries);
+    std::transform(candidates.begin(), candidates.begin() + n_queries, points.begin(),
+                   [](const std::pair<uint64_t, int> &p) { return p.first; });
+    return std::make_pair(keys, points);
+}
+
+/**
+ * Writes the queries [p, p + range_size - 1] for the points 'points' to the directory 'queries_path', with a random
+ * power-of-two range size up to 'range_size' for each query if 'mixed' is set.
+ */
+void save_real_queries(const std::vector<uint64_t> &points, uint64_t range_size, const std::string &queries_path,
+                       bool mixed = false) {
+    if (!create_dir_recursive(queries_path))
+        throw std::runtime_error("error, impossible to create dir");
+
     std::mt19937 gen_range(seed);
-    auto right_pow = static_cast<int>(std::floor(std::log2(range_list.back())));
+    auto right_pow = static_cast<int>(std::floor(std::log2(range_size)));
     std::uniform_int_distribution<uint64_t> range_distr(0, right_pow);
 
-    for (auto it = candidates.begin(); it < candidates.begin() + n_queries; ++it) {
-        for (auto i = 0; i < range_list.size(); i++)
-        {
-            auto range_q = point_to_range(it->first, range_list[i]);
-            if (range_q.first > range_q.second)
-                throw std::runtime_error("unexpected error, queries are not sorted");
-            queries_list[i].emplace_back(range_q.first, range_q.second, false);
-        }
-
-        if (mixed_queries)
-        {
-            auto range_size = static_cast<uint64_t>(std::exp2(range_distr(gen_range)));
-            auto range_q = point_to_range(it->first, range_size);
-            queries_list[range_list.size()].emplace_back(range_q.first, range_q.second, false);
-        }
+    const auto point = (range_size == 1 && !mixed);
+    QueryWriter out(queries_path + (point ? "point" : "left"), point ? "" : queries_path + "right");
+    for (auto p : points) {
+        auto range_q = point_to_range(p, mixed ? static_cast<uint64_t>(std::exp2(range_distr(gen_range))) : range_size);
+        if (range_q.first > range_q.second)
+            throw std::runtime_error("unexpected error, queries are not sorted");
+        out.add(range_q.first, range_q.second, false);
     }
-
-    return std::make_pair(keys, queries_list);
+    out.close();
+    std::cout << "[+] queries wrote at " << queries_path << std::endl;
 }
 
 template <typename value_type = uint64_t>
@@ -441,32 +932,14 @@ void generate_real_dataset(const std::string& file, uint64_t n_queries, std::vec
     assert(all_data.size() > n_queries);
 
     std::cout << "[+] starting `" << dir_name << "` dataset generation" << std::endl;
-    auto [keys, queries_list] = generate_real_queries(all_data, n_queries, ranges);
+    auto [keys, points] = generate_real_queries(all_data, n_queries, ranges);
     std::cout << std::endl << "[+] full dataset generated" << std::endl;
-    std::cout << "[+] nkeys=" << keys.size() << ", nqueries=" << queries_list[0].size() << std::endl;
-
-    for (auto i = 0; i < ranges.size(); i++) {
-        auto range_size = ranges[i];
-
-        std::string queries_path = root_path + std::to_string(range_size_list[i]) + "/";
-        if (!create_dir_recursive(queries_path))
-            throw std::runtime_error("error, impossible to create dir");
-        if (range_size == 1)
-            save_queries(queries_list[i], queries_path + "point");
-        else
-            save_queries(queries_list[i], queries_path + "left", queries_path + "right");
-        std::cout << "[+] queries wrote at " << queries_path << std::endl;
-    }
+    std::cout << "[+] nkeys=" << keys.size() << ", nqueries=" << points.size() << std::endl;
 
+    for (size_t i = 0; i < ranges.size(); i++)
+        save_real_queries(points, ranges[i], root_path + std::to_string(range_size_list[i]) + "/");
     if (mixed_queries)
-    {
-        std::string queries_path = root_path + std::to_string(range_size_list.back()) + "M/";
-        if (!create_dir_recursive(queries_path))
-            throw std::runtime_error("error, impossible to create dir");
-
-        save_queries(queries_list.back(), queries_path + "left", queries_path + "right");
-        std::cout << "[+] queries wrote at " << queries_path << std::endl;
-    }
+        save_real_queries(points, ranges.back(), root_path + std::to_string(range_size_list.back()) + "M/", true);
 
     save_keys(keys, root_path + "keys");
     std::cout << "[+] keys wrote at " << root_path << std::endl;
@@ -521,6 +994,42 @@ int main(int argc, char const *argv[]) {
             .implicit_value(true)
             .default_value(false);
 
+    parser.add_argument("--unsorted-queries")
+            .help("writes the queries in generation order rather than sorted by their endpoints, which is faster and "
+                  "needs no temporary files, but changes the access pattern of the benchmarks")
+            .implicit_value(true)
+            .default_value(false);
+
+    parser.add_argument("--zipf-theta")
+            .help("the exponent of the Zipfian distribution of the hot spots of qzipf, in (0, 1)")
+            .default_value(zipf_theta)
+            .scan<'g', double>();
+
+    parser.add_argument("--clusters")
+            .help("the number of clusters of kclustered")
+            .default_value(n_clusters)
+            .scan<'i', int>();
+
+    parser.add_argument("--adv-bpk")
+            .help("the bits per key of the filter targeted by qadversarial, which gives the size of its reduced universe")
+            .default_value(adv_bpk)
+            .scan<'g', double>();
+
+    parser.add_argument("--adv-pow2")
+            .help("the filter targeted by qadversarial rounds its reduced universe to a power of two")
+            .implicit_value(true)
+            .default_value(false);
+
+    parser.add_argument("--seed")
+            .help("the seed of the generators, the output is the same for the same seed")
+            .default_value(s)
+            .scan<'i', int>();
+
+    parser.add_argument("--threads")
+            .help("the number of threads of the key generation")
+            .default_value(int(n_threads))
+            .scan<'i', int>();
+
     parser.add_argument("--corr-degree")
             .help("Correlation degree for correlated workloads")
             .required()
@@ -554,8 +1063,19 @@ int main(int argc, char const *argv[]) {
     auto ranges_int = parser.get<std::vector<int>>("--range-size");
     auto corr_degree = parser.get<double>("--corr-degree");
 
+    s = parser.get<int>("--seed");
+    zipf_theta = parser.get<double>("--zipf-theta");
+    n_clusters = parser.get<int>("--clusters");
+    adv_bpk = parser.get<double>("--adv-bpk");
+    adv_pow2 = parser.get<bool>("--adv-pow2");
+    if (zipf_theta <= 0 || zipf_theta >= 1)
+        throw std::runtime_error("error, the Zipfian exponent must be in (0, 1)");
+    if (n_clusters < 1)
+        throw std::runtime_error("error, the number of clusters must be positive");
+    n_threads = std::max(1, parser.get<int>("--threads"));
     allow_true_queries = parser.get<bool>("--allow-true");
     mixed_queries = parser.get<bool>("--mixed");
+    sort_queries = !parser.get<bool>("--unsorted-queries");
 
     assert((n_keys > 0) && (n_queries > 0));
     assert(!kdist.empty());
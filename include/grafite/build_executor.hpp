@@ -0,0 +1,328 @@
+/*
+ * This file is part of Grafite <https://github.com/marcocosta97/grafite>.
+ * Copyright (C) 2023 Marco Costa.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+namespace grafite {
+
+/**
+ * The build_executor class is the interface used by the grafite data structures to run the parallel phases of their
+ * construction. Sharing one executor among all the constructions of the application bounds the number of threads
+ * used by concurrent builds, rather than letting each build spawn its own threads.
+ *
+ * The executor used by the constructors is the one set with grafite::set_build_executor. If no executor is set, the
+ * constructors fall back to the sorting algorithm chosen at compile time via the USE_LIBRARY_* macros.
+ */
+class build_executor
+{
+public:
+    virtual ~build_executor() = default;
+
+    /**
+     * Returns the number of tasks that the executor can run concurrently.
+     */
+    [[nodiscard]] virtual size_t concurrency() const = 0;
+
+    /**
+     * Runs 'task(i)' for each i in [0, n_tasks) and returns when all of them are completed. The calling thread takes
+     * part in the execution of the tasks, thus this method can be called from within a task. If some task throws,
+     * the first exception is rethrown once all the tasks are completed.
+     */
+    virtual void run(size_t n_tasks, const std::function<void(size_t)> &task) = 0;
+
+    /**
+     * Returns a reference to the executor used by the grafite constructors, nullptr if none. The pointer is atomic,
+     * since it can be set while other threads are building.
+     */
+    static std::atomic<build_executor *> &global()
+    {
+        static std::atomic<build_executor *> executor{nullptr};
+        return executor;
+    }
+};
+
+/**
+ * Sets the executor used by the grafite constructors, nullptr to restore the default behaviour. The executor must
+ * outlive all the constructions that use it.
+ */
+inline void set_build_executor(build_executor *executor)
+{
+    build_executor::global().store(executor);
+}
+
+/**
+ * The work_stealing_executor class is a build_executor backed by a fixed pool of threads. Each thread owns a queue of
+ * tasks: it pops its own tasks from the back and, when its queue is empty, it steals tasks from the front of the
+ * queues of the other threads.
+ *
+ * The threads that call 'run' also execute tasks while waiting, and block on a condition variable when there is
+ * nothing left to steal. Every thread must hold one of the 'n_threads' slots of the pool to execute tasks, thus the
+ * number of threads working on the builds, calling threads included, never exceeds the size of the pool. A task that
+ * calls 'run' gives back its slot while it waits for the nested tasks.
+ */
+class work_stealing_executor : public build_executor
+{
+private:
+    struct task_queue
+    {
+        std::mutex m;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<task_queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> pending{0}; /* the number of tasks in the queues */
+    std::atomic<size_t> next_queue{0};
+    std::atomic<bool> stop{false};
+    size_t free_slots; /* the number of threads that can start executing tasks, guarded by 'sleep_m' */
+    std::mutex sleep_m;
+    std::condition_variable sleep_cv;
+
+    /**
+     * Returns a reference to the executor whose slot is held by the calling thread, nullptr if none.
+     */
+    static const work_stealing_executor *&slot_holder()
+    {
+        static thread_local const work_stealing_executor *executor = nullptr;
+        return executor;
+    }
+
+    /**
+     * Pops a task from the queue 'self' or, if empty, steals one from the other queues.
+     */
+    bool try_pop(const size_t self, std::function<void()> &task)
+    {
+        for (size_t i = 0; i < queues.size(); ++i)
+        {
+            auto &q = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.m);
+            if (q.tasks.empty())
+                continue;
+            if (i == 0)
+                task = std::move(q.tasks.back()), q.tasks.pop_back();
+            else
+                task = std::move(q.tasks.front()), q.tasks.pop_front();
+            --pending;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Executes the tasks in the queues, starting from the queue 'self', while 'keep_going()' holds and there are tasks
+     * left. The lock on 'sleep_m' must be held by the caller, which must have taken a slot.
+     */
+    template <class Predicate>
+    void drain(std::unique_lock<std::mutex> &lock, const size_t self, Predicate keep_going)
+    {
+        lock.unlock();
+        auto *previous = std::exchange(slot_holder(), this);
+        std::function<void()> task;
+        while (keep_going() && try_pop(self, task))
+            task();
+        slot_holder() = previous;
+        lock.lock();
+        ++free_slots;
+        sleep_cv.notify_all();
+    }
+
+    void worker_loop(const size_t self)
+    {
+        std::unique_lock<std::mutex> lock(sleep_m);
+        while (true)
+        {
+            sleep_cv.wait(lock, [&] { return stop || (pending > 0 && free_slots > 0); });
+            if (stop)
+                return;
+            --free_slots;
+            drain(lock, self, [] { return true; });
+        }
+    }
+
+public:
+    /**
+     * Constructs the pool with 'n_threads' threads and slots, by default the number of hardware threads.
+     */
+    explicit work_stealing_executor(size_t n_threads = std::thread::hardware_concurrency())
+    {
+        n_threads = std::max<size_t>(1, n_threads);
+        free_slots = n_threads;
+        for (size_t i = 0; i < n_threads; ++i)
+            queues.emplace_back(std::make_unique<task_queue>());
+        for (size_t i = 0; i < n_threads; ++i)
+            workers.emplace_back(&work_stealing_executor::worker_loop, this, i);
+    }
+
+    work_stealing_executor(const work_stealing_executor &) = delete;
+    work_stealing_executor &operator=(const work_stealing_executor &) = delete;
+
+    ~work_stealing_executor() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_m);
+            stop = true;
+        }
+        sleep_cv.notify_all();
+        for (auto &w : workers)
+            w.join();
+    }
+
+    [[nodiscard]] size_t concurrency() const override
+    {
+        return workers.size();
+    }
+
+    void run(const size_t n_tasks, const std::function<void(size_t)> &task) override
+    {
+        if (n_tasks == 0)
+            return;
+
+        std::atomic<size_t> remaining(n_tasks);
+        std::exception_ptr error;
+        std::mutex error_m;
+
+        {
+            std::lock_guard<std::mutex> lock(sleep_m);
+            pending += n_tasks;
+        }
+        for (size_t i = 0; i < n_tasks; ++i)
+        {
+            auto &q = *queues[next_queue++ % queues.size()];
+            std::lock_guard<std::mutex> lock(q.m);
+            q.tasks.emplace_back([&, i] {
+                try { task(i); }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> error_lock(error_m);
+                    if (!error)
+                        error = std::current_exception();
+                }
+                /* the caller may return as soon as 'remaining' is zero, thus only the members are used afterwards */
+                if (--remaining == 0)
+                {
+                    std::lock_guard<std::mutex> lock(sleep_m);
+                    sleep_cv.notify_all();
+                }
+            });
+        }
+        sleep_cv.notify_all();
+
+        /*
+         * The calling thread executes tasks while it can take a slot and there are tasks to steal, otherwise it sleeps
+         * until its tasks are completed. A nested call gives back the slot of the calling task while it waits, and
+         * takes a slot again before returning to it.
+         */
+        const auto self = next_queue.load() % queues.size();
+        const bool nested = (slot_holder() == this);
+        std::unique_lock<std::mutex> lock(sleep_m);
+        if (nested)
+        {
+            ++free_slots;
+            sleep_cv.notify_all();
+        }
+        while (true)
+        {
+            sleep_cv.wait(lock, [&] { return remaining == 0 || (pending > 0 && free_slots > 0); });
+            if (remaining == 0)
+                break;
+            --free_slots;
+            drain(lock, self, [&] { return remaining > 0; });
+        }
+        if (nested)
+        {
+            sleep_cv.wait(lock, [&] { return free_slots > 0; });
+            --free_slots;
+        }
+        lock.unlock();
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
+/**
+ * Sorts the vector 'v', whose elements are at most 'max_value', with the tasks of the executor. The elements are
+ * first distributed in parallel into buckets of equal width of the range [0, max_value], as the hashed keys of the
+ * grafite::filter are uniformly distributed in the reduced universe, and then each bucket is sorted by a task.
+ *
+ * @tparam T the type of the elements (must be an unsigned integer type)
+ * @param executor the executor running the tasks
+ * @param v the vector to sort
+ * @param max_value the maximum element of the vector
+ */
+template <class T>
+void parallel_sort(build_executor &executor, std::vector<T> &v, const T max_value)
+{
+    constexpr size_t min_chunk_size = 1 << 16;
+    const auto n = v.size();
+    const auto n_chunks = std::min(executor.concurrency(), n / min_chunk_size);
+    if (n_chunks <= 1)
+    {
+        std::sort(v.begin(), v.end());
+        return;
+    }
+
+    const auto n_buckets = 4 * n_chunks;
+    const T width = max_value / n_buckets + 1;
+    auto chunk_begin = [&](size_t c) { return (c * n) / n_chunks; };
+
+    std::vector<size_t> offsets(n_chunks * n_buckets, 0); /* chunk-major histogram, then the offset of each pair */
+    executor.run(n_chunks, [&](size_t c) {
+        for (auto i = chunk_begin(c); i < chunk_begin(c + 1); ++i)
+            offsets[c * n_buckets + v[i] / width]++;
+    });
+
+    std::vector<size_t> bucket_begin(n_buckets + 1, 0);
+    size_t sum = 0;
+    for (size_t b = 0; b < n_buckets; ++b)
+    {
+        bucket_begin[b] = sum;
+        for (size_t c = 0; c < n_chunks; ++c)
+        {
+            auto count = offsets[c * n_buckets + b];
+            offsets[c * n_buckets + b] = sum;
+            sum += count;
+        }
+    }
+    bucket_begin[n_buckets] = n;
+
+    std::vector<T> out(n);
+    executor.run(n_chunks, [&](size_t c) {
+        auto *pos = &offsets[c * n_buckets];
+        for (auto i = chunk_begin(c); i < chunk_begin(c + 1); ++i)
+            out[pos[v[i] / width]++] = v[i];
+    });
+    executor.run(n_buckets, [&](size_t b) {
+        std::sort(out.begin() + bucket_begin[b], out.begin() + bucket_begin[b + 1]);
+    });
+    v.swap(out);
+}
+
+} // namespace grafite
@@ -0,0 +1,276 @@
+/*
+ * This file is part of Grafite <https://github.com/marcocosta97/grafite>.
+ * Copyright (C) 2023 Marco Costa.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "grafite.hpp"
+
+namespace grafite {
+
+/**
+ * The statistics of the queries whose length is in [min_length, max_length], as collected by grafite::fpr_monitor.
+ */
+struct fpr_stats
+{
+    uint64_t min_length, max_length;
+    uint64_t queries; /* the number of queries */
+    uint64_t positives; /* the number of positive answers of the filter */
+    uint64_t sampled; /* the number of positive answers whose ground truth has been reported */
+    uint64_t false_positives; /* the number of sampled positive answers reported as empty ranges */
+    double expected_fpr; /* the average FPR predicted by the model of the filter */
+
+    /**
+     * Returns the estimated FPR, i.e. the fraction of the queries on empty ranges answered positively. The number of
+     * false positives is extrapolated from the sample to all the positive answers, while the negative answers are
+     * always on empty ranges, as the filter has no false negatives.
+     */
+    [[nodiscard]] double observed_fpr() const
+    {
+        if (sampled == 0)
+            return 0;
+        const double est_false_positives = double(positives) * false_positives / sampled;
+        const double empty_queries = double(queries - positives) + est_false_positives;
+        return empty_queries > 0 ? est_false_positives / empty_queries : 0;
+    }
+};
+
+/**
+ * The fpr_monitor class wraps a grafite::filter (or any filter providing 'expected_fpr(length)') and compares the
+ * false positive rate observed on the workload against the one predicted by the model, i.e. '(l * n)/r' for the
+ * queries of length 'l'.
+ *
+ * The wrapper counts the queries and the positive answers, while the caller reports the ground truth of a sample of
+ * the positive answers (e.g. after reading the data from disk) via the 'report' method. The statistics are kept per
+ * range-length class, where the class of length 'l' is 'floor(log2(l))'. Each thread querying the monitor registers
+ * its own block of counters on its first query (under a mutex), padded to its own cache lines and written only by that
+ * thread with relaxed loads and stores, so that concurrent queries neither lock, nor share cache lines, nor issue
+ * atomic read-modify-write instructions. The blocks are summed by 'stats' and live as long as the monitor, and a
+ * thread whose id is reused after the exit of another one continues on the block of the latter.
+ *
+ * If the observed FPR drifts past the model, e.g. because the distribution of the queries changed, 'drifted' returns
+ * true and 'suggested_extra_bpk' returns the number of bits per key to add when rebuilding the filter.
+ *
+ * @tparam FilterType the type of the monitored filter
+ */
+template <class FilterType>
+class fpr_monitor
+{
+private:
+    using value_type = uint64_t;
+
+    constexpr static size_t n_classes = 64;
+    constexpr static size_t n_cached = 8; /* the number of monitors whose counters each thread finds without locking */
+    constexpr static double expected_scale = double(1ULL << 24); /* the fixed point scale of the expected FPR sums */
+
+    /* The counters are written by a single thread, so they are increased with a load and a store, not with a RMW. */
+    struct counter
+    {
+        std::atomic<uint64_t> v{0};
+
+        inline void add(const uint64_t x)
+        {
+            v.store(v.load(std::memory_order_relaxed) + x, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] inline uint64_t get() const
+        {
+            return v.load(std::memory_order_relaxed);
+        }
+    };
+
+    struct counters
+    {
+        counter queries, positives, sampled, false_positives, expected_sum;
+    };
+
+    struct alignas(64) thread_counters
+    {
+        std::array<counters, n_classes> classes;
+    };
+
+    struct cache_entry
+    {
+        uint64_t monitor_id = 0;
+        thread_counters *block = nullptr;
+    };
+
+    FilterType f;
+    const uint64_t id; /* never reused, unlike the address, so that the thread caches do not outlive the monitor */
+    mutable std::mutex m;
+    std::unordered_map<std::thread::id, std::unique_ptr<thread_counters>> threads;
+
+    static inline size_t length_class(const value_type length)
+    {
+        return 63 - __builtin_clzll(std::max<value_type>(1, length));
+    }
+
+    static inline uint64_t next_id()
+    {
+        static std::atomic<uint64_t> last{0};
+        return last.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    /* Returns the counters of the calling thread, registering them on the first call of the thread. */
+    inline counters &local(const size_t c)
+    {
+        thread_local std::array<cache_entry, n_cached> cache{};
+        thread_local size_t next_evicted = 0;
+        for (auto &e : cache)
+            if (e.monitor_id == id)
+                return e.block->classes[c];
+
+        thread_counters *t;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            auto &p = threads[std::this_thread::get_id()];
+            if (!p)
+                p = std::make_unique<thread_counters>();
+            t = p.get();
+        }
+        cache[next_evicted] = {id, t};
+        next_evicted = (next_evicted + 1) % n_cached;
+        return t->classes[c];
+    }
+
+public:
+    /**
+     * Constructs the monitor of the filter 'filter', which is moved into the monitor.
+     */
+    explicit fpr_monitor(FilterType &&filter) : f(std::move(filter)), id(next_id()) {}
+
+    fpr_monitor(const fpr_monitor &) = delete;
+    fpr_monitor &operator=(const fpr_monitor &) = delete;
+
+    /**
+     * Returns the monitored filter.
+     */
+    const FilterType &filter() const
+    {
+        return f;
+    }
+
+    /**
+     * Queries the range [left, right] on the filter and updates the counters of its length class.
+     */
+    template <class T>
+    bool query(const T left, const T right)
+    {
+        const auto length = value_type(right - left) + 1;
+        const bool res = f.query(left, right);
+        auto &c = local(length_class(length));
+        c.queries.add(1);
+        c.positives.add(res);
+        c.expected_sum.add(uint64_t(f.expected_fpr(length) * expected_scale));
+        return res;
+    }
+
+    template <class T>
+    bool query(const T k)
+    {
+        return query(k, k);
+    }
+
+    /**
+     * Reports the ground truth of a positive answer of the range [left, right]: 'non_empty' is false if the range
+     * turned out to contain no key, i.e. the answer was a false positive.
+     */
+    template <class T>
+    void report(const T left, const T right, const bool non_empty)
+    {
+        auto &c = local(length_class(value_type(right - left) + 1));
+        c.sampled.add(1);
+        c.false_positives.add(!non_empty);
+    }
+
+    /**
+     * Returns the statistics of the length classes with at least one query.
+     */
+    [[nodiscard]] std::vector<fpr_stats> stats() const
+    {
+        std::vector<fpr_stats> out;
+        std::lock_guard<std::mutex> lock(m);
+        for (size_t c = 0; c < n_classes; ++c)
+        {
+            fpr_stats st{value_type(1) << c, c == 63 ? ~value_type(0) : (value_type(2) << c) - 1, 0, 0, 0, 0, 0};
+            uint64_t expected_sum = 0;
+            for (const auto &[tid, t] : threads)
+            {
+                const auto &cnt = t->classes[c];
+                st.queries += cnt.queries.get();
+                st.positives += cnt.positives.get();
+                st.sampled += cnt.sampled.get();
+                st.false_positives += cnt.false_positives.get();
+                expected_sum += cnt.expected_sum.get();
+            }
+            if (st.queries == 0)
+                continue;
+            st.expected_fpr = expected_sum / expected_scale / st.queries;
+            out.push_back(st);
+        }
+        return out;
+    }
+
+    /**
+     * Returns true if, in some length class with at least 'min_samples' sampled positive answers, the observed FPR
+     * is greater than 'tolerance' times the expected one.
+     */
+    [[nodiscard]] bool drifted(const double tolerance = 2.0, const uint64_t min_samples = 100) const
+    {
+        for (const auto &st : stats())
+            if (st.sampled >= min_samples && st.observed_fpr() > tolerance * st.expected_fpr)
+                return true;
+        return false;
+    }
+
+    /**
+     * Returns the number of bits per key to add to the budget of the filter so that the expected FPR matches the
+     * observed one in the worst length class with at least 'min_samples' sampled positive answers, as each bit halves
+     * the FPR. Returns 0 if the observed FPR is within the model.
+     */
+    [[nodiscard]] double suggested_extra_bpk(const uint64_t min_samples = 100) const
+    {
+        double extra = 0;
+        for (const auto &st : stats())
+            if (st.sampled >= min_samples && st.expected_fpr > 0 && st.observed_fpr() > st.expected_fpr)
+                extra = std::max(extra, std::log2(st.observed_fpr() / st.expected_fpr));
+        return std::ceil(extra);
+    }
+
+    /**
+     * Resets all the counters, e.g. after a rebuild. It must not be called concurrently with the queries.
+     */
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(m);
+        for (auto &[tid, t] : threads)
+            for (auto &cnt : t->classes)
+                for (auto *x : {&cnt.queries, &cnt.positives, &cnt.sampled, &cnt.false_positives, &cnt.expected_sum})
+                    x->v.store(0, std::memory_order_relaxed);
+    }
+};
+
+} // namespace grafite
@@ -23,10 +23,18 @@
 #include <algorithm>
 #include <type_traits>
 #include <utility>
+#include <iterator>
 #include <cmath>
 #include <set>
 #include <bitset>
 #include <random>
+#include <limits>
+#include <functional>
+
+#include "cpu_dispatch.hpp"
+#include "memory.hpp"
+#include "query_stats.hpp"
+#include "sort.hpp"
 
 #ifdef SUCCINCT_LIB_SDSL
 #include "sdsl/sd_vector.hpp"
@@ -36,13 +44,6 @@
 #include "sux/bits/EliasFano.hpp"
 #endif
 
-#if defined(USE_LIBRARY_BOOST_PARALLEL) || defined(USE_LIBRARY_BOOST)
-#include <boost/sort/sort.hpp>
-#define MAX_THREADS 12
-#elif defined(USE_LIBRARY_STL_PARALLEL)
-#include <execution>
-#endif
-
 namespace grafite {
 
 template<typename T> struct is_vector : public std::false_type {};
@@ -60,6 +61,24 @@ struct is_iterable<T, std::void_t<decltype(std::begin(std::declval<T>())),
 template <class T>
 constexpr bool is_iterable_v = is_iterable<T>::value;
 
+template <class T, class = void>
+struct has_check_membership : std::false_type {};
+
+template <class T>
+struct has_check_membership<T, std::void_t<decltype(std::declval<const T>().check_membership(uint64_t()))>> : std::true_type {};
+
+template <class T>
+constexpr bool has_check_membership_v = has_check_membership<T>::value;
+
+template <class T, class = void>
+struct has_memory_report : std::false_type {};
+
+template <class T>
+struct has_memory_report<T, std::void_t<decltype(std::declval<const T>().memory_report())>> : std::true_type {};
+
+template <class T>
+constexpr bool has_memory_report_v = has_memory_report<T>::value;
+
 #ifdef SUCCINCT_LIB_SUX
 /**
  * The ef_sux_vector class is a wrapper for the Elias-Fano implementation using the SUX library.
@@ -106,6 +125,17 @@ public:
         return check_presence(x, x);
     }
 
+    /**
+     * @brief Checks if 'x' is in the set with a single predecessor query.
+     *
+     * Note that 'x' must be greater than or equal to the smallest element of the set.
+     */
+    template <class t_value>
+    bool check_membership(const t_value x) const
+    {
+        return *(ef.predecessor(x)) == x;
+    }
+
     ef_sux_vector &operator=(ef_sux_vector &&v) noexcept
     {
         if (this != &v)
@@ -137,6 +167,39 @@ public:
         return ef.bitCount() / 8;
     }
 
+    /**
+     * @brief Returns the memory used by the container, broken down into its components.
+     *
+     * The library does not expose its components, thus the breakdown is an estimate and 'estimated_breakdown' is
+     * set. The sizes of the lower and upper bits are derived from the number of elements 'n' and the universe 'u' as
+     * 'n * l' and 'n + u / 2^l + 1' bits, with 'l = floor(log2(u/n))', both rounded up to 64-bit words. The select
+     * and rank indexes are the remaining part of the size reported by the library, so the total is measured. The
+     * allocator overhead assumes four heap blocks, with the index split evenly between the select and the
+     * select-zero structures (see grafite::heap_overhead).
+     */
+    [[nodiscard]] grafite::memory_report memory_report() const
+    {
+        grafite::memory_report m;
+        m.header_bytes = sizeof(ef_sux_vector);
+        m.estimated_breakdown = true;
+
+        const uint64_t u = ef.size(); /* the length of the bitvector, i.e. the universe */
+        const uint64_t n = u > 0 ? ef.rank(u) : 0;
+        if (n > 0)
+        {
+            const int l = u / n > 0 ? 63 - __builtin_clzll(u / n) : 0;
+            m.lower_bits_bytes = ((n * l + 63) / 64) * 8;
+            m.upper_bits_bytes = ((n + (u >> l) + 1 + 63) / 64) * 8;
+        }
+
+        const uint64_t reported = size();
+        const uint64_t known = m.header_bytes + m.lower_bits_bytes + m.upper_bits_bytes;
+        m.index_bytes = reported > known ? reported - known : 0;
+        m.slack_bytes = heap_overhead(m.lower_bits_bytes) + heap_overhead(m.upper_bits_bytes)
+                        + 2 * heap_overhead(m.index_bytes / 2);
+        return m;
+    }
+
 };
 #endif
 
@@ -189,11 +252,41 @@ public:
         return check_presence(k, k);
     }
 
+    /**
+     * @brief Checks if 'k' is in the set by accessing the k-th bit of the sparse bitvector.
+     *
+     * Note that 'k' must be smaller than the size of the bitvector, i.e. not greater than the largest element of the set.
+     */
+    template <class t_value>
+    inline bool check_membership(const t_value k) const
+    {
+        return ef[k];
+    }
+
     [[nodiscard]] auto size() const
     {
         return sdsl::size_in_bytes(ef) + sdsl::size_in_bytes(ef_rank); //+ sdsl::size_in_bytes(ef_select);
     }
 
+    /**
+     * @brief Returns the memory used by the container, broken down into its components. The lower and upper bits are
+     * the sizes of the corresponding vectors of the sparse bitvector, the select and rank indexes are the remaining
+     * part of the size reported by the library.
+     */
+    [[nodiscard]] grafite::memory_report memory_report() const
+    {
+        grafite::memory_report m;
+        m.header_bytes = sizeof(ef_sdsl_vector);
+        m.lower_bits_bytes = sdsl::size_in_bytes(ef.low);
+        m.upper_bits_bytes = sdsl::size_in_bytes(ef.high);
+
+        const uint64_t reported = size();
+        const uint64_t known = m.lower_bits_bytes + m.upper_bits_bytes;
+        m.index_bytes = reported > known ? reported - known : 0;
+        m.slack_bytes = heap_overhead(m.lower_bits_bytes) + heap_overhead(m.upper_bits_bytes);
+        return m;
+    }
+
     friend std::ostream &operator<<(std::ostream &out, const ef_sdsl_vector &v)
     {
         v.ef.serialize(out);
@@ -212,20 +305,87 @@ public:
 };
 #endif
 
+/**
+ * Returns the memory report of a container: its own 'memory_report()' if provided, otherwise its content as
+ * 'data_bytes' for the vectors, and its 'size()' as 'data_bytes' for the other containers.
+ */
+template <class Container>
+memory_report container_memory_report(const Container &c)
+{
+    if constexpr (has_memory_report_v<Container>)
+        return c.memory_report();
+    else if constexpr (is_vector<Container>())
+    {
+        memory_report m;
+        m.header_bytes = sizeof(Container);
+        m.data_bytes = c.size() * sizeof(typename Container::value_type);
+        add_vector_slack(m, c);
+        return m;
+    }
+#ifdef SUCCINCT_LIB_SDSL
+    else if constexpr (std::is_same_v<Container, sdsl::int_vector<>>)
+    {
+        memory_report m;
+        m.header_bytes = sizeof(Container);
+        m.data_bytes = sdsl::size_in_bytes(c);
+        m.slack_bytes = heap_overhead(m.data_bytes);
+        return m;
+    }
+#endif
+    else
+    {
+        memory_report m;
+        m.header_bytes = sizeof(Container);
+        m.data_bytes = c.size();
+        return m;
+    }
+}
+
+/**
+ * Writes the number of elements and the elements of a vector of trivially copyable values, used to serialize the
+ * parameters of the data structures.
+ */
+template <class T>
+void write_vector(std::ostream &out, const std::vector<T> &v)
+{
+    static_assert(std::is_trivially_copyable_v<T>, "the elements must be trivially copyable");
+    const uint64_t n = v.size();
+    out.write(reinterpret_cast<const char *>(&n), sizeof(n));
+    out.write(reinterpret_cast<const char *>(v.data()), n * sizeof(T));
+}
+
+/**
+ * Reads a vector written by grafite::write_vector.
+ */
+template <class T>
+void read_vector(std::istream &in, std::vector<T> &v)
+{
+    static_assert(std::is_trivially_copyable_v<T>, "the elements must be trivially copyable");
+    uint64_t n = 0;
+    in.read(reinterpret_cast<char *>(&n), sizeof(n));
+    v.resize(in ? n : 0);
+    in.read(reinterpret_cast<char *>(v.data()), v.size() * sizeof(T));
+}
+
 /**
  * The grafite::bucket class implements the heuristic range filter data structure described in the paper: [...].
  * The filter is a probabilistic data structure that can be used to answer range queries in a set of integers.
  * Since the filter is probabilistic, it can return false positives, but no false negatives.
  * Since this range filter is heuristic, the false positive rate (FPR) cannot be controlled by the user.
  *
+ * If 'pow2_buckets' is set, the size of each bucket is rounded to the nearest power of two 's = 2^shift', so that the
+ * keys and the query endpoints are mapped to their buckets with a shift rather than a division. The rounding changes
+ * the size of the filter by at most half a bit per key, in either direction.
+ *
  * @tparam EliasFanoDS the Elias-Fano data structure used to store the buckets.
+ * @tparam pow2_buckets if true, the size of each bucket is a power of two
  */
 #if defined(SUCCINCT_LIB_SUX)
-template <class EliasFanoDS = ef_sux_vector>
+template <class EliasFanoDS = ef_sux_vector, bool pow2_buckets = false>
 #elif defined(SUCCINCT_LIB_SDSL)
-template <class EliasFanoDS = ef_sdsl_vector>
+template <class EliasFanoDS = ef_sdsl_vector, bool pow2_buckets = false>
 #else
-template <class EliasFanoDS>
+template <class EliasFanoDS, bool pow2_buckets = false>
 #endif
 class bucket
 {
@@ -233,8 +393,19 @@ private:
     using value_type = uint64_t;
 
     EliasFanoDS bv;
-    value_type last;
-    value_type s; /* the size of each bucket */
+    value_type last = 0;
+    value_type s = 1; /* the size of each bucket */
+    uint8_t shift = 0; /* log2(s), used if pow2_buckets is set */
+
+    /**
+     * Maps the value 'x' to its bucket.
+     */
+    inline value_type to_bucket(const value_type x) const
+    {
+        if constexpr (pow2_buckets)
+            return x >> shift;
+        return x / s;
+    }
 
     /**
      * The bucket constructor builds the data structure from a sorted input sequence and the size of each bucket
@@ -258,20 +429,53 @@ private:
             throw std::overflow_error("error, the universe overflows");
 
         value_type u = *(end - 1) + 1;
-        s = std::ceil(_s);
+        /* the sizes above 2^63 are clamped, as they would overflow and leave the keys in at most two buckets anyway */
+        s = (_s >= 0x1p63) ? value_type(1) << 63 : std::ceil(_s);
 
         if (s <= 0) throw std::runtime_error("error, the requested bucket size is < 1");
-        value_type n = ((u + s - 1)/s);
+        if constexpr (pow2_buckets)
+        {
+            shift = std::clamp<long long>(std::llround(std::log2(_s)), 0, 63);
+            s = value_type(1) << shift;
+        }
+        value_type n = (u - 1) / s + 1;
         value_type max_m = std::min(n, (value_type) std::distance(begin, end));
 
-        std::vector<typename t_itr::value_type> pos;
-        pos.reserve(max_m);
-        pos.push_back((*begin)/s);
-        for (auto it = begin + 1; it < end; ++it)
+        std::vector<typename std::iterator_traits<t_itr>::value_type> pos;
+        if (auto *executor = build_executor::global().load())
         {
-            auto curr = (*it)/s;
-            if (curr != pos.back())
-                pos.push_back(curr);
+            /*
+             * Each task computes the non-empty buckets of a chunk of the input, then the chunks are concatenated by
+             * removing the bucket shared by the end of a chunk and the beginning of the next one.
+             */
+            const auto n_keys = (size_t) std::distance(begin, end);
+            const auto n_chunks = std::max<size_t>(1, std::min(executor->concurrency(), n_keys >> 16));
+            std::vector<std::vector<typename std::iterator_traits<t_itr>::value_type>> chunks(n_chunks);
+            executor->run(n_chunks, [&](size_t c) {
+                auto it = begin + (c * n_keys) / n_chunks, chunk_end = begin + ((c + 1) * n_keys) / n_chunks;
+                auto &chunk_pos = chunks[c];
+                chunk_pos.push_back(to_bucket(*it));
+                for (++it; it < chunk_end; ++it)
+                {
+                    auto curr = to_bucket(*it);
+                    if (curr != chunk_pos.back())
+                        chunk_pos.push_back(curr);
+                }
+            });
+            pos.reserve(max_m);
+            for (const auto &chunk_pos : chunks)
+                pos.insert(pos.end(), chunk_pos.begin() + (!pos.empty() && pos.back() == chunk_pos.front()), chunk_pos.end());
+        }
+        else
+        {
+            pos.reserve(max_m);
+            pos.push_back(to_bucket(*begin));
+            for (auto it = begin + 1; it < end; ++it)
+            {
+                auto curr = to_bucket(*it);
+                if (curr != pos.back())
+                    pos.push_back(curr);
+            }
         }
 
         last = pos.back();
@@ -298,6 +502,7 @@ public:
     {
         bv = std::move(b.bv);
         s = std::move(b.s);
+        shift = std::move(b.shift);
         last = std::move(b.last);
     }
 
@@ -307,6 +512,7 @@ public:
         {
             bv = std::move(b.bv);
             s = std::move(b.s);
+            shift = std::move(b.shift);
             last = std::move(b.last);
         }
         return *this;
@@ -321,9 +527,8 @@ public:
      */
     inline bool query(const value_type left, const value_type right) const
     {
-        auto l = left/s, r = right/s;
+        auto l = to_bucket(left), r = std::min(to_bucket(right), last);
         if (l > last) return false;
-        if (r > last) r = last;
 
         if constexpr (std::is_same_v<EliasFanoDS, ef_sux_vector>)
             return bv.check_presence_bs(l, r);
@@ -341,6 +546,22 @@ public:
         return query(x, x);
     }
 
+    /**
+     * The batch query function checks the ranges [*l_begin, *r_begin], [*(l_begin + 1), *(r_begin + 1)], ... and writes
+     * the results into 'out'. The loop is compiled for each CPU level (see GRAFITE_MULTIVERSION).
+     *
+     * @param l_begin the begin iterator of the left endpoints
+     * @param l_end the end iterator of the left endpoints
+     * @param r_begin the begin iterator of the right endpoints
+     * @param out the output iterator of the results
+     */
+    template <class l_itr, class r_itr, class o_itr>
+    GRAFITE_MULTIVERSION void query(l_itr l_begin, const l_itr l_end, r_itr r_begin, o_itr out) const
+    {
+        for (; l_begin != l_end; ++l_begin, ++r_begin, ++out)
+            *out = query(*l_begin, *r_begin);
+    }
+
     /**
      * The size function returns the size of the bucket in bytes.
      *
@@ -350,235 +571,1399 @@ public:
     {
         return bv.size() + sizeof(bucket);
     }
+
+    /**
+     * The memory_report function returns the memory used by the bucket, broken down into its components.
+     */
+    [[nodiscard]] grafite::memory_report memory_report() const
+    {
+        auto m = container_memory_report(bv);
+        m.header_bytes += sizeof(bucket) - sizeof(bv);
+        return m;
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const bucket &b)
+    {
+        out.write(reinterpret_cast<const char *>(&b.last), sizeof(b.last));
+        out.write(reinterpret_cast<const char *>(&b.s), sizeof(b.s));
+        out.write(reinterpret_cast<const char *>(&b.shift), sizeof(b.shift));
+        out << b.bv;
+        return out;
+    }
+
+    friend std::istream &operator>>(std::istream &in, bucket &b)
+    {
+        in.read(reinterpret_cast<char *>(&b.last), sizeof(b.last));
+        in.read(reinterpret_cast<char *>(&b.s), sizeof(b.s));
+        in.read(reinterpret_cast<char *>(&b.shift), sizeof(b.shift));
+        in >> b.bv;
+        return in;
+    }
 };
 
 
 /**
- * The grafite::filter class implements the range filter data structure described in the paper: [...].
- * The filter is a probabilistic data structure that can be used to answer range queries in a set of integers.
- * Since the filter is probabilistic, it can return false positives, but no false negatives. The probability of
- * false positives can be controlled by the user, and it is called the false positive rate (FPR). The FPR is
- * defined as the probability that the filter returns true for a range that is not in the set. The FPR is
- * guaranteed to be less than or equal to 'eps' for range queries of size at most 'L'. The FPR for range queries of
- * size 'l' can be precisely measured by the formula 'FPR_l = (l * n)/r'. Where it still holds the equation 'r = (n*L)/eps'.
- *
- * We advice to use the filter using the Elias-Fano data structure, since it is the most efficient one and is the
- * one proposed in the paper. However, any data structure that is either iterable or supports the following operations
- * can be used:
- *  - check_presence(a, b): returns true if it exists an element 'x' in the set such that 'a <= x <= b'. False otherwise.
- *  - check_presence(a): returns true if it exists an element 'x' in the set such that 'x == a'. False otherwise.
- *  - size(): returns the size of the data structure in bytes.
- *
- * If using the Elias-Fano data structure we proved the following bounds:
- *  - The space complexity is 'n * log(L/eps) + 2n + o(n)' bits (i.e. 2 bpk more than the lower bound).
- *  - The query time is 'O(log(L/eps))'. If setting a constant space budget 'b', the query time is 'O(b) = O(1)'.
+ * The grafite::adaptive_bucket class is a variant of the grafite::bucket heuristic range filter in which the size of
+ * the buckets changes across the key space. The universe is split into segments, and each segment 'j' uses buckets of
+ * size 's_j'. The bucket of a key 'x' in the segment starting at 'b_j' is 'offset_j + (x - b_j)/s_j', where 'offset_j'
+ * is the number of buckets in the previous segments, so that a single Elias-Fano data structure stores the non-empty
+ * buckets of all the segments.
  *
- * NOTE: the vector of hashed elements passed to RangeEmptinessDS may have duplicated elements (due to the hashing
- *       collision). The RangeEmptinessDS should handle this case. In fact, it must be disabled if the user cares
- *       about the approximate range count. Otherwise, it can be approximated using the formula
- *       'approx number of collisions = n*eps/(2L)'.
- *
- * If available (and enabled at compile time) this data structure makes use of the Boost library and/or multithreading
- * to speed-up the sorting algorithm. The user can enable/disable these features by defining the macros:
- *  - USE_LIBRARY_BOOST_PARALLEL: enables the use of the Boost library in multithreading.
- *  - USE_LIBRARY_BOOST: enables the use of the Boost library in single thread.
- *  - USE_LIBRARY_STL_PARALLEL: enables the use of the standard library in multithreading.
+ * The segments contain the same number of keys, thus by assigning the same bits per key to each of them, dense
+ * regions of the key space get finer buckets and sparse regions coarser ones. If a sample of the queries is given, the
+ * bits per key of each segment are instead set to 'b_j = max(2, bpk + log2(q_j/n_j) - c)', where 'q_j' is the number of
+ * queries in the segment and 'c' keeps the total budget equal to 'n * bpk' bits. This allocation minimizes the expected
+ * FPR on the sample, which for a segment is proportional to '2^(-b_j)'. Like the grafite::bucket, the FPR cannot be
+ * controlled by the user.
  *
- * @tparam RangeEmptinessDS the data structure used to check the emptiness of a range.
- * @tparam default_bpk_overhead the default number of bits per key overhead used by the data structure used to
- *                              check the emptiness of a range.
+ * @tparam EliasFanoDS the Elias-Fano data structure used to store the buckets.
  */
 #if defined(SUCCINCT_LIB_SUX)
-template <class RangeEmptinessDS = ef_sux_vector, unsigned int default_bpk_overhead = 2>
+template <class EliasFanoDS = ef_sux_vector>
 #elif defined(SUCCINCT_LIB_SDSL)
-template <class RangeEmptinessDS = ef_sdsl_vector, unsigned int default_bpk_overhead = 2>
+template <class EliasFanoDS = ef_sdsl_vector>
 #else
-template <class RangeEmptinessDS, unsigned int default_bpk_overhead = 0>
+template <class EliasFanoDS>
 #endif
-class filter
+class adaptive_bucket
 {
 private:
-    using value_type = uint64_t; /* the type of the elements in the set */
+    using value_type = uint64_t;
 
-    constexpr static value_type p = (1UL << 61) - 1UL; /* a huge prime */
-    static std::random_device rd;
-    static std::mt19937 gen;
-    static std::uniform_int_distribution<value_type> distr;
+    EliasFanoDS bv;
+    value_type last = 0;
+    std::vector<value_type> breakpoints; /* the first key of each segment, the first segment starts at 0 */
+    std::vector<value_type> widths; /* the size of the buckets of each segment */
+    std::vector<value_type> offsets; /* the number of buckets before each segment */
 
-    RangeEmptinessDS ds; /* the container data structure used to check the emptiness of a range */
-    value_type a, b, r, n_items; /* the parameters of the data structure */
-    value_type first, last; /* the first and last element of the set */
+    /**
+     * Maps the value 'x' to its bucket, the mapping is non-decreasing in 'x'.
+     */
+    inline value_type to_bucket(const value_type x) const
+    {
+        auto j = std::distance(breakpoints.begin(), std::upper_bound(breakpoints.begin(), breakpoints.end(), x)) - 1;
+        return offsets[j] + (x - breakpoints[j]) / widths[j];
+    }
 
     /**
-     * @brief Hashes the input value using the formula: '(((a * (x / r) + b) % p) + x) % r'.
-     *
-     * This function is used to map the elements of the set to the range [0, r), where 'r' is the size of the reduced
-     * universe. Moreover, this hash function is 2-independent, that is, two different elements of the set are mapped
-     * to the same hashed values with probability 1/r.
-     * See ^[https://en.wikipedia.org/wiki/K-independent_hashing] for more details.
-     *
-     * @tparam T the type of the input value (must be an arithmetic type)
-     * @param x the input value
-     * @return the hashed value
+     * Builds the data structure from a sorted input sequence, split into 'n_segments' segments with the same number
+     * of keys, where the segment 'j' uses 'segment_bpk[j]' bits per key.
      */
-    template <class T, class = typename std::enable_if<std::is_arithmetic<T>::value, T>::type>
-    inline value_type hash(const T x) const
+    template <class t_itr>
+    void build(const t_itr begin, const t_itr end, const std::vector<double> &segment_bpk)
     {
-        return (((a * (x / r) + b) % p) + x) % r;
+        const auto n = (size_t) std::distance(begin, end);
+        const auto n_segments = segment_bpk.size();
+        breakpoints.resize(n_segments), widths.resize(n_segments), offsets.resize(n_segments);
+
+        value_type n_buckets = 0;
+        for (size_t j = 0; j < n_segments; ++j)
+        {
+            auto s_begin = begin + (j * n) / n_segments, s_end = begin + ((j + 1) * n) / n_segments;
+            breakpoints[j] = (j == 0) ? 0 : *s_begin;
+            auto range = (j + 1 < n_segments) ? *s_end - breakpoints[j] : *(end - 1) - breakpoints[j] + 1;
+            widths[j] = std::max<value_type>(1, std::ceil(range / (std::distance(s_begin, s_end) * std::exp2(segment_bpk[j] - 2))));
+            offsets[j] = n_buckets;
+            n_buckets += (range + widths[j] - 1) / widths[j];
+        }
+
+        std::vector<value_type> pos;
+        pos.reserve(n);
+        pos.push_back(to_bucket(*begin));
+        for (auto it = begin + 1; it < end; ++it)
+        {
+            auto curr = to_bucket(*it);
+            if (curr != pos.back())
+                pos.push_back(curr);
+        }
+
+        last = pos.back();
+        bv = EliasFanoDS(pos.begin(), pos.end());
     }
 
-#ifdef SUCCINCT_LIB_SDSL
-    template <class Q = RangeEmptinessDS>
-    class std::enable_if<std::is_same<Q, sdsl::int_vector<0>>::value, void>::type
-    compress()
+    template <class t_itr>
+    static void check_input(const t_itr begin, const t_itr end, const size_t n_segments)
     {
-        sdsl::util::bit_compress(ds);
+        if (!std::is_sorted(begin, end))
+            throw std::runtime_error("error, the input is not sorted");
+        if (*(end - 1) > std::numeric_limits<value_type>::max() - 1)
+            throw std::overflow_error("error, the universe overflows");
+        if (n_segments == 0 || n_segments > (size_t) std::distance(begin, end))
+            throw std::runtime_error("error, the number of segments must be in [1, n]");
     }
-#endif
+
+public:
+    adaptive_bucket() = default;
 
     /**
-     * Main constructor for the grafite::filter class. It takes as input a range of elements and the size of the reduced
-     * universe r (see the paper for more details). The constructor computes the parameters of the data structure and
-     * builds the filter.
-     *
-     * Note that if the maximum element in the input range is smaller than 'r', the constructor will throw an exception.
-     * In fact, this is means to construct an approximate range filter such that its size in bits per key is greater
-     * that the size of a lossless encoding of the input keys without any approximation (which occupies log2(u/n) + 2 bpk).
+     * Constructs the data structure from a sorted range of integers by specifying the (approximate) size of the
+     * resulting range filter as bits per key. The size of the buckets of each segment adapts to the density of the
+     * keys in the segment.
      *
-     * @tparam t_itr the type of the iterator used to iterate over the input range
-     * @param r the size of the reduced universe
-     * @param begin the iterator to the first element of the input range
-     * @param end the iterator to the last element of the input range
+     * @tparam t_itr the type of the iterator
+     * @param begin the beginning of the sorted range of keys
+     * @param end the end of the sorted range of keys
+     * @param bpk the desired number of bits per key
+     * @param n_segments the number of segments
      */
     template <class t_itr>
-    filter(const value_type _r, const t_itr begin, const t_itr end)
-            : ds(), a(distr(gen)), b(distr(gen)), r(_r), n_items(std::distance(begin, end)), first(), last()
+    adaptive_bucket(const t_itr begin, const t_itr end, const double bpk, const size_t n_segments = 64)
     {
         if (begin == end)
             return;
+        check_input(begin, end, n_segments);
+        build(begin, end, std::vector<double>(n_segments, bpk));
+    }
 
-        while ((a == 0) || (a >= p)) { a = distr(gen); }
-        while (b >= p) { b = distr(gen);}
-        a %= r, b %= r;
+    /**
+     * Constructs the data structure from a sorted range of integers by specifying the (approximate) size of the
+     * resulting range filter as bits per key. The bits per key are distributed among the segments proportionally to
+     * the logarithm of the number of queries of the sample [q_begin, q_end) that fall in each of them. The queries can
+     * be any iterable of pairs or tuples whose first element is the left endpoint of the range.
+     *
+     * @tparam t_itr the type of the iterator of the keys
+     * @tparam q_itr the type of the iterator of the queries
+     * @param begin the beginning of the sorted range of keys
+     * @param end the end of the sorted range of keys
+     * @param bpk the desired number of bits per key
+     * @param q_begin the begin iterator of the query sample
+     * @param q_end the end iterator of the query sample
+     * @param n_segments the number of segments
+     */
+    template <class t_itr, class q_itr>
+    adaptive_bucket(const t_itr begin, const t_itr end, const double bpk, const q_itr q_begin, const q_itr q_end,
+                    const size_t n_segments = 64)
+    {
+        if (begin == end)
+            return;
+        check_input(begin, end, n_segments);
 
-        std::vector<value_type> temp(n_items);
-        typename t_itr::value_type max_input_key = 0;
+        const auto n = (size_t) std::distance(begin, end);
+        std::vector<value_type> first_keys(n_segments);
+        for (size_t j = 0; j < n_segments; ++j)
+            first_keys[j] = (j == 0) ? 0 : *(begin + (j * n) / n_segments);
 
         /*
-         * The following code hashes the input elements into the temporary vector and computes the maximum element in
-         * the input range (since the input is not required to be sorted).
+         * The count of each segment starts from 1, so that segments without queries still get some bits.
          */
-        std::transform(begin, end, temp.begin(), [&](auto x) {
-            max_input_key = std::max(max_input_key, x);
-            return hash(x); });
+        std::vector<double> count(n_segments, 1);
+        for (auto it = q_begin; it != q_end; ++it)
+        {
+            value_type left = std::get<0>(*it);
+            count[std::distance(first_keys.begin(), std::upper_bound(first_keys.begin(), first_keys.end(), left)) - 1]++;
+        }
 
-        if (max_input_key < this->r) /* equivalent to bpk > 2 + log2(u/n) */
-            throw std::runtime_error("error, the requested bpk is higher than a lossless compressed encoding of the input data");
+        std::vector<double> log_ratio(n_segments), weight(n_segments);
+        for (size_t j = 0; j < n_segments; ++j)
+        {
+            weight[j] = (double) ((((j + 1) * n) / n_segments) - ((j * n) / n_segments)) / n;
+            log_ratio[j] = std::log2(count[j] / (weight[j] * n));
+        }
 
-#if defined(USE_LIBRARY_BOOST_PARALLEL)
-        /*
-         * The following code uses the Boost library to sort the elements in parallel. The number of threads is set to
-         * the minimum between the number of available threads and 8.
-         */
-#ifdef MAX_THREADS
-        auto n_threads = std::min(std::thread::hardware_concurrency(), (unsigned int) MAX_THREADS);
-#else
-        auto n_threads = std::min(std::thread::hardware_concurrency(), (unsigned int) 8);
-#endif
-        boost::sort::block_indirect_sort(temp.begin(), temp.end(), n_threads);
-#elif defined(USE_LIBRARY_BOOST)
-        /*
-         * The following code uses the Boost library to sort the elements in a single thread, via spreadsort function.
-         * This function is faster than std::sort and exploits the fact that the size of the maximum hash is bounded
-         * via hybrid radix sort.
-         */
-        boost::sort::spreadsort::spreadsort(temp.begin(), temp.end());
-#elif defined(USE_LIBRARY_STL_PARALLEL)
         /*
-         * The following code uses the STL library to sort the elements in parallel via execution policies.
+         * The segments get 'b_j = max(2, bpk + log2(q_j/n_j) - c)' bits per key, since a segment cannot have buckets
+         * finer than its keys. The clamping raises the budget, thus 'c' is found by bisection so that the mean of the
+         * bits per key weighted by the number of keys is 'bpk' (all the segments get 2 bits per key if 'bpk <= 2').
          */
-        std::sort(std::execution::par, temp.begin(), temp.end());
-#else
-        std::sort(temp.begin(), temp.end());
-#endif
+        auto clamped_bpk = [&](const double c, const size_t j) { return std::max(2.0, bpk + log_ratio[j] - c); };
+        auto budget = [&](const double c) {
+            double b = 0;
+            for (size_t j = 0; j < n_segments; ++j)
+                b += clamped_bpk(c, j) * weight[j];
+            return b;
+        };
+        double lo = *std::min_element(log_ratio.begin(), log_ratio.end()) - 2;
+        double hi = *std::max_element(log_ratio.begin(), log_ratio.end()) + std::max(0.0, bpk - 2);
+        for (auto i = 0; i < 100 && hi - lo > 1e-9; ++i)
+        {
+            auto mid = (lo + hi) / 2;
+            (budget(mid) > bpk ? lo : hi) = mid;
+        }
 
-        first = temp.front(), last = temp.back();
-        ds = RangeEmptinessDS{temp.begin(), temp.end()};
+        std::vector<double> segment_bpk(n_segments);
+        for (size_t j = 0; j < n_segments; ++j)
+            segment_bpk[j] = clamped_bpk(hi, j);
 
-#ifdef SUCCINCT_LIB_SDSL
-        if constexpr (std::is_same_v<RangeEmptinessDS, sdsl::int_vector<>>)
-            compress();
-#endif
+        build(begin, end, segment_bpk);
     }
 
-public:
+    adaptive_bucket(adaptive_bucket &&b) noexcept
+    {
+        bv = std::move(b.bv);
+        last = std::move(b.last);
+        breakpoints = std::move(b.breakpoints);
+        widths = std::move(b.widths);
+        offsets = std::move(b.offsets);
+    }
 
-    filter() = default;
+    adaptive_bucket &operator=(adaptive_bucket &&b) noexcept
+    {
+        if (this != &b)
+        {
+            bv = std::move(b.bv);
+            last = std::move(b.last);
+            breakpoints = std::move(b.breakpoints);
+            widths = std::move(b.widths);
+            offsets = std::move(b.offsets);
+        }
+        return *this;
+    }
 
     /**
-     * @brief This constructor allows to specify the false positive rate 'eps' desired for the range queries of size 'L'.
-     * The size of the reduced universe r is calculated as r = (n * L)/eps, where 'n' is the number of elements in the input
-     * range. The false positive rate for a range query of size 'l' is bounded by the formula 'eps_l = (l * eps)/L'.
+     * The query function checks if the range [left, right] is present in the data structure.
      *
-     * @tparam t_itr the iterator type
-     * @param begin the start iterator of the input keys
-     * @param end the end iterator of the input keys
-     * @param eps the false positive rate desired for the range queries of size 'L'
-     * @param L the maximum range size for which the false positive rate is guaranteed
+     * @param left the left endpoint of the range
+     * @param right the right endpoint of the range
+     * @return true if the range is present, false otherwise
+     */
+    inline bool query(const value_type left, const value_type right) const
+    {
+        if (breakpoints.empty())
+            return false;
+        auto l = to_bucket(left), r = to_bucket(right);
+        if (l > last) return false;
+        if (r > last) r = last;
+
+        if constexpr (std::is_same_v<EliasFanoDS, ef_sux_vector>)
+            return bv.check_presence_bs(l, r);
+        return bv.check_presence(l, r);
+    }
+
+    /**
+     * The query function checks if the element [x] is present in the data structure.
+     *
+     * @param x the point
+     * @return true if the element is present, false otherwise
+     */
+    inline bool query(const value_type x) const
+    {
+        return query(x, x);
+    }
+
+    /**
+     * The size function returns the size of the data structure in bytes, including the segments.
+     *
+     * @return the size of the data structure in bytes
+     */
+    inline auto size() const
+    {
+        return bv.size() + sizeof(adaptive_bucket) + breakpoints.size() * 3 * sizeof(value_type);
+    }
+
+    /**
+     * The memory_report function returns the memory used by the data structure, broken down into its components. The
+     * segments are accounted as header bytes.
+     */
+    [[nodiscard]] grafite::memory_report memory_report() const
+    {
+        auto m = container_memory_report(bv);
+        m.header_bytes += sizeof(adaptive_bucket) - sizeof(bv);
+        for (const auto *v : {&breakpoints, &widths, &offsets})
+        {
+            m.header_bytes += v->size() * sizeof(value_type);
+            add_vector_slack(m, *v);
+        }
+        return m;
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const adaptive_bucket &b)
+    {
+        out.write(reinterpret_cast<const char *>(&b.last), sizeof(b.last));
+        write_vector(out, b.breakpoints);
+        write_vector(out, b.widths);
+        write_vector(out, b.offsets);
+        out << b.bv;
+        return out;
+    }
+
+    friend std::istream &operator>>(std::istream &in, adaptive_bucket &b)
+    {
+        in.read(reinterpret_cast<char *>(&b.last), sizeof(b.last));
+        read_vector(in, b.breakpoints);
+        read_vector(in, b.widths);
+        read_vector(in, b.offsets);
+        in >> b.bv;
+        return in;
+    }
+};
+
+/**
+ * The grafite::multi_bucket class is a hierarchical variant of the grafite::bucket heuristic range filter. It stores
+ * the non-empty buckets at several levels, whose bucket sizes are powers of two spaced by a factor '2^level_gap'. The
+ * bits per key are split among the levels, so that the finest level gets 'b_f = (bpk + level_gap * L(L - 1)/2)/L' bits
+ * per key, and each coarser level 'level_gap' bits per key less than the previous one.
+ *
+ * Since each level answers a superset of the keys of the finer levels, a query checks the levels from the coarsest to
+ * the finest and exits early as soon as a level answers negatively. Moreover, the query stops at the first level whose
+ * bucket size is not larger than the range size, since for long ranges the FPR is dominated by the range size rather
+ * than by the size of the buckets. Thus, long range queries are answered by the coarse levels and point queries by the
+ * finest one.
+ *
+ * @tparam EliasFanoDS the Elias-Fano data structure used to store the buckets.
+ */
+#if defined(SUCCINCT_LIB_SUX)
+template <class EliasFanoDS = ef_sux_vector>
+#elif defined(SUCCINCT_LIB_SDSL)
+template <class EliasFanoDS = ef_sdsl_vector>
+#else
+template <class EliasFanoDS>
+#endif
+class multi_bucket
+{
+private:
+    using value_type = uint64_t;
+
+    struct level
+    {
+        EliasFanoDS bv;
+        value_type last = 0;
+        uint8_t shift = 0; /* the size of each bucket is 2^shift */
+
+        level() = default;
+
+        level(level &&l) noexcept
+        {
+            bv = std::move(l.bv);
+            last = l.last;
+            shift = l.shift;
+        }
+    };
+
+    std::vector<level> levels; /* from the coarsest to the finest */
+
+public:
+    multi_bucket() = default;
+
+    /**
+     * Constructs the data structure from a sorted range of integers by specifying the (approximate) size of the
+     * resulting range filter as bits per key.
+     *
+     * @tparam t_itr the type of the iterator
+     * @param begin the beginning of the sorted range of keys
+     * @param end the end of the sorted range of keys
+     * @param bpk the desired number of bits per key, summed over all the levels
+     * @param n_levels the number of levels
+     * @param level_gap the base-2 logarithm of the ratio between the bucket sizes of consecutive levels
+     */
+    template <class t_itr>
+    multi_bucket(const t_itr begin, const t_itr end, const double bpk, const unsigned int n_levels = 2,
+                 const unsigned int level_gap = 6)
+    {
+        if (begin == end)
+            return;
+        if (!std::is_sorted(begin, end))
+            throw std::runtime_error("error, the input is not sorted");
+        if (n_levels == 0)
+            throw std::runtime_error("error, the requested number of levels is < 1");
+
+        const auto n = std::distance(begin, end);
+        const auto u = (double) *(end - 1) + 1;
+        const auto finest_bpk = (bpk + level_gap * n_levels * (n_levels - 1) / 2.0) / n_levels;
+        const auto finest_shift = (int) std::max(0.0, std::round(std::log2(u / (n * std::exp2(finest_bpk - 2)))));
+
+        levels.resize(n_levels);
+        std::vector<value_type> pos;
+        pos.reserve(n);
+        for (unsigned int i = 0; i < n_levels; ++i)
+        {
+            auto &lv = levels[i];
+            lv.shift = std::min(63, finest_shift + (int) ((n_levels - 1 - i) * level_gap));
+
+            pos.clear();
+            pos.push_back((*begin) >> lv.shift);
+            for (auto it = begin + 1; it < end; ++it)
+            {
+                auto curr = (*it) >> lv.shift;
+                if (curr != pos.back())
+                    pos.push_back(curr);
+            }
+
+            lv.last = pos.back();
+            lv.bv = EliasFanoDS(pos.begin(), pos.end());
+        }
+    }
+
+    multi_bucket(multi_bucket &&b) noexcept = default;
+
+    multi_bucket &operator=(multi_bucket &&b) noexcept = default;
+
+    /**
+     * The query function checks if the range [left, right] is present in the data structure.
+     *
+     * @param left the left endpoint of the range
+     * @param right the right endpoint of the range
+     * @return true if the range is present, false otherwise
+     */
+    inline bool query(const value_type left, const value_type right) const
+    {
+        if (levels.empty()) /* built from an empty input */
+            return false;
+        for (const auto &lv : levels)
+        {
+            auto l = left >> lv.shift, r = right >> lv.shift;
+            if (l > lv.last) return false;
+            if (r > lv.last) r = lv.last;
+
+            bool present;
+            if constexpr (std::is_same_v<EliasFanoDS, ef_sux_vector>)
+                present = lv.bv.check_presence_bs(l, r);
+            else
+                present = lv.bv.check_presence(l, r);
+
+            if (!present)
+                return false;
+            if ((right - left) >> lv.shift) /* the range is at least as large as a bucket of this level */
+                return true;
+        }
+        return true;
+    }
+
+    /**
+     * The query function checks if the element [x] is present in the data structure.
+     *
+     * @param x the point
+     * @return true if the element is present, false otherwise
+     */
+    inline bool query(const value_type x) const
+    {
+        return query(x, x);
+    }
+
+    /**
+     * The size function returns the size of the data structure in bytes, summed over all the levels.
+     *
+     * @return the size of the data structure in bytes
+     */
+    inline auto size() const
+    {
+        size_t s = sizeof(multi_bucket);
+        for (const auto &lv : levels)
+            s += lv.bv.size() + sizeof(level);
+        return s;
+    }
+
+    /**
+     * The memory_report function returns the memory used by the data structure, summed over all the levels.
+     */
+    [[nodiscard]] grafite::memory_report memory_report() const
+    {
+        grafite::memory_report m;
+        m.header_bytes = sizeof(multi_bucket);
+        for (const auto &lv : levels)
+        {
+            m += container_memory_report(lv.bv);
+            m.header_bytes += sizeof(level) - sizeof(lv.bv);
+        }
+        add_vector_slack(m, levels);
+        return m;
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const multi_bucket &b)
+    {
+        const uint64_t n_levels = b.levels.size();
+        out.write(reinterpret_cast<const char *>(&n_levels), sizeof(n_levels));
+        for (const auto &lv : b.levels)
+        {
+            out.write(reinterpret_cast<const char *>(&lv.last), sizeof(lv.last));
+            out.write(reinterpret_cast<const char *>(&lv.shift), sizeof(lv.shift));
+            out << lv.bv;
+        }
+        return out;
+    }
+
+    friend std::istream &operator>>(std::istream &in, multi_bucket &b)
+    {
+        uint64_t n_levels = 0;
+        in.read(reinterpret_cast<char *>(&n_levels), sizeof(n_levels));
+        b.levels.clear();
+        b.levels.resize(in ? n_levels : 0);
+        for (auto &lv : b.levels)
+        {
+            in.read(reinterpret_cast<char *>(&lv.last), sizeof(lv.last));
+            in.read(reinterpret_cast<char *>(&lv.shift), sizeof(lv.shift));
+            in >> lv.bv;
+        }
+        return in;
+    }
+};
+
+/**
+ * Returns the smallest power of two greater than or equal to 'x'.
+ */
+inline uint64_t next_pow2(const uint64_t x)
+{
+    if (x <= 1)
+        return 1;
+    if (x > (uint64_t(1) << 63))
+        throw std::overflow_error("error, the reduced universe overflows");
+    return uint64_t(1) << (64 - __builtin_clzll(x - 1));
+}
+
+/**
+ * Returns the random generator shared by the hash policies to draw their parameters.
+ */
+inline std::mt19937_64 &hash_generator()
+{
+    static std::random_device rd;
+    static std::mt19937_64 gen(rd());
+    return gen;
+}
+
+/**
+ * The hash policies of the grafite::filter class. A hash policy maps the keys to the reduced universe [0, r) with a
+ * locality-preserving hash function of the form 'h(x) = (g(x / r) + x) mod r', where 'g' is a hash function of the
+ * block 'x / r'. Thus, the keys of a range of size at most 'r' are mapped to at most two ranges of hashed values.
+ *
+ * A hash policy must provide:
+ *  - universe(r): a static method returning the size of the reduced universe actually used for the requested 'r'.
+ *  - init(r): draws the parameters of the hash function for the reduced universe 'r'.
+ *  - operator()(x, r): returns the hashed value of 'x'.
+ *  - operator()(begin, end, out, r): hashes the keys in [begin, end) into 'out', marked with GRAFITE_MULTIVERSION (see
+ *    cpu_dispatch.hpp). Only the multiply_shift_hash kernel is vectorized, the other policies compute a 64-bit
+ *    division or a SipHash per key, thus their batch variant is a plain loop over the single-key method.
+ *  - operator<< and operator>>: serialize the parameters of the hash function.
+ */
+
+/**
+ * The modular_hash policy is the hash function proposed in the paper, i.e. '(((a * (x / r) + b) % p) + x) % r' with
+ * 'p = 2^61 - 1'. This hash function is 2-independent, that is, two different elements of the set are mapped to the
+ * same hashed values with probability 1/r.
+ * See ^[https://en.wikipedia.org/wiki/K-independent_hashing] for more details.
+ *
+ * If 'pow2_universe' is set, 'r' is rounded up to a power of two, so that the division and the modulo by 'r' become a
+ * shift and a mask.
+ *
+ * @tparam pow2_universe if true, the size of the reduced universe is rounded up to a power of two.
+ */
+template <bool pow2_universe = false>
+class modular_hash
+{
+private:
+    using value_type = uint64_t;
+
+    constexpr static value_type p = (1UL << 61) - 1UL; /* a huge prime */
+
+    value_type a = 0, b = 0;
+    uint8_t shift = 0; /* log2(r), used if pow2_universe is set */
+
+public:
+    static value_type universe(const value_type r)
+    {
+        if constexpr (pow2_universe)
+            return next_pow2(r);
+        return r;
+    }
+
+    void init(const value_type r)
+    {
+        std::uniform_int_distribution<value_type> distr(1, std::numeric_limits<value_type>::max());
+        a = distr(hash_generator()), b = distr(hash_generator());
+        while ((a == 0) || (a >= p)) { a = distr(hash_generator()); }
+        while (b >= p) { b = distr(hash_generator()); }
+        a %= r, b %= r;
+        if constexpr (pow2_universe)
+            shift = __builtin_ctzll(universe(r));
+    }
+
+    template <class T, class = typename std::enable_if<std::is_arithmetic<T>::value, T>::type>
+    inline value_type operator()(const T x, const value_type r) const
+    {
+        if constexpr (pow2_universe)
+            return (((a * (value_type(x) >> shift) + b) % p) + x) & (r - 1);
+        return (((a * (x / r) + b) % p) + x) % r;
+    }
+
+    template <class t_itr, class o_itr>
+    GRAFITE_MULTIVERSION void operator()(t_itr begin, const t_itr end, o_itr out, const value_type r) const
+    {
+        for (; begin != end; ++begin, ++out)
+            *out = (*this)(*begin, r);
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const modular_hash &h)
+    {
+        out.write(reinterpret_cast<const char *>(&h.a), sizeof(h.a));
+        out.write(reinterpret_cast<const char *>(&h.b), sizeof(h.b));
+        if constexpr (pow2_universe)
+            out.write(reinterpret_cast<const char *>(&h.shift), sizeof(h.shift));
+        return out;
+    }
+
+    friend std::istream &operator>>(std::istream &in, modular_hash &h)
+    {
+        in.read(reinterpret_cast<char *>(&h.a), sizeof(h.a));
+        in.read(reinterpret_cast<char *>(&h.b), sizeof(h.b));
+        if constexpr (pow2_universe)
+            in.read(reinterpret_cast<char *>(&h.shift), sizeof(h.shift));
+        return in;
+    }
+};
+
+/**
+ * The multiply_shift_hash policy hashes the block 'x / r' with the multiply-shift scheme 'g(y) = (a * y) >> (64 - k)',
+ * where 'a' is a random odd 64-bit integer and 'r = 2^k' is rounded up to a power of two. This hash function is
+ * universal (two different blocks collide with probability at most 2/r) and it is computed without any division.
+ * See ^[https://en.wikipedia.org/wiki/Universal_hashing#Avoiding_modular_arithmetic] for more details.
+ */
+class multiply_shift_hash
+{
+private:
+    using value_type = uint64_t;
+
+    value_type a = 0;
+    uint8_t k = 1; /* log2 of the size of the reduced universe */
+
+public:
+    static value_type universe(const value_type r)
+    {
+        return std::max<value_type>(2, next_pow2(r));
+    }
+
+    void init(const value_type r)
+    {
+        a = hash_generator()() | 1;
+        k = __builtin_ctzll(universe(r));
+    }
+
+    template <class T, class = typename std::enable_if<std::is_arithmetic<T>::value, T>::type>
+    inline value_type operator()(const T x, const value_type r) const
+    {
+        return (((a * (value_type(x) >> k)) >> (64 - k)) + value_type(x)) & (r - 1);
+    }
+
+    /**
+     * The batch kernel indexes the input and the output from their beginning, with all the parameters of the hash
+     * function in registers, so that the compiler vectorizes it on random-access iterators (with 64-bit
+     * multiplications on x86-64-v4, emulating them with 32-bit ones on x86-64-v3 and x86-64). Other iterators fall
+     * back to the single-key method.
+     */
+    template <class t_itr, class o_itr>
+    GRAFITE_MULTIVERSION void operator()(t_itr begin, const t_itr end, o_itr out, const value_type r) const
+    {
+        const value_type mask = r - 1, mul = a;
+        const unsigned int shift = k, high_shift = 64 - k;
+        if constexpr (std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<t_itr>::iterator_category>
+                      && std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<o_itr>::iterator_category>)
+        {
+            const size_t n = std::distance(begin, end);
+            for (size_t i = 0; i < n; ++i)
+            {
+                const value_type x = begin[i];
+                out[i] = (((mul * (x >> shift)) >> high_shift) + x) & mask;
+            }
+        }
+        else
+            for (; begin != end; ++begin, ++out)
+                *out = (*this)(*begin, r);
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const multiply_shift_hash &h)
+    {
+        out.write(reinterpret_cast<const char *>(&h.a), sizeof(h.a));
+        out.write(reinterpret_cast<const char *>(&h.k), sizeof(h.k));
+        return out;
+    }
+
+    friend std::istream &operator>>(std::istream &in, multiply_shift_hash &h)
+    {
+        in.read(reinterpret_cast<char *>(&h.a), sizeof(h.a));
+        in.read(reinterpret_cast<char *>(&h.k), sizeof(h.k));
+        return in;
+    }
+};
+
+/**
+ * The keyed_hash policy hashes the block 'x / r' with SipHash-2-4 under a random 128-bit secret key. Differently from
+ * the other policies, an adversary who does not know the key cannot compute which blocks collide even by observing
+ * the hashed values of some keys, at the cost of a slower hash function.
+ * See ^[https://en.wikipedia.org/wiki/SipHash] for more details.
+ */
+class keyed_hash
+{
+private:
+    using value_type = uint64_t;
+
+    value_type k0 = 0, k1 = 0;
+
+    static inline value_type rotl(const value_type x, const int b)
+    {
+        return (x << b) | (x >> (64 - b));
+    }
+
+    static inline void sip_round(value_type &v0, value_type &v1, value_type &v2, value_type &v3)
+    {
+        v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+        v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+        v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+        v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+    }
+
+    /**
+     * Returns SipHash-2-4 of the 8-byte message 'm'.
+     */
+    inline value_type siphash(const value_type m) const
+    {
+        value_type v0 = k0 ^ 0x736f6d6570736575ULL, v1 = k1 ^ 0x646f72616e646f6dULL;
+        value_type v2 = k0 ^ 0x6c7967656e657261ULL, v3 = k1 ^ 0x7465646279746573ULL;
+        const value_type last_block = value_type(8) << 56;
+
+        v3 ^= m;
+        sip_round(v0, v1, v2, v3);
+        sip_round(v0, v1, v2, v3);
+        v0 ^= m;
+        v3 ^= last_block;
+        sip_round(v0, v1, v2, v3);
+        sip_round(v0, v1, v2, v3);
+        v0 ^= last_block;
+        v2 ^= 0xff;
+        for (auto i = 0; i < 4; ++i)
+            sip_round(v0, v1, v2, v3);
+        return v0 ^ v1 ^ v2 ^ v3;
+    }
+
+public:
+    static value_type universe(const value_type r)
+    {
+        return r;
+    }
+
+    void init(const value_type)
+    {
+        k0 = hash_generator()(), k1 = hash_generator()();
+    }
+
+    template <class T, class = typename std::enable_if<std::is_arithmetic<T>::value, T>::type>
+    inline value_type operator()(const T x, const value_type r) const
+    {
+        return ((siphash(value_type(x) / r) % r) + (value_type(x) % r)) % r;
+    }
+
+    template <class t_itr, class o_itr>
+    GRAFITE_MULTIVERSION void operator()(t_itr begin, const t_itr end, o_itr out, const value_type r) const
+    {
+        for (; begin != end; ++begin, ++out)
+            *out = (*this)(*begin, r);
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const keyed_hash &h)
+    {
+        out.write(reinterpret_cast<const char *>(&h.k0), sizeof(h.k0));
+        out.write(reinterpret_cast<const char *>(&h.k1), sizeof(h.k1));
+        return out;
+    }
+
+    friend std::istream &operator>>(std::istream &in, keyed_hash &h)
+    {
+        in.read(reinterpret_cast<char *>(&h.k0), sizeof(h.k0));
+        in.read(reinterpret_cast<char *>(&h.k1), sizeof(h.k1));
+        return in;
+    }
+};
+
+/**
+ * The grafite::filter class implements the range filter data structure described in the paper: [...].
+ * The filter is a probabilistic data structure that can be used to answer range queries in a set of integers.
+ * Since the filter is probabilistic, it can return false positives, but no false negatives. The probability of
+ * false positives can be controlled by the user, and it is called the false positive rate (FPR). The FPR is
+ * defined as the probability that the filter returns true for a range that is not in the set. The FPR is
+ * guaranteed to be less than or equal to 'eps' for range queries of size at most 'L'. The FPR for range queries of
+ * size 'l' can be precisely measured by the formula 'FPR_l = (l * n)/r'. Where it still holds the equation 'r = (n*L)/eps'.
+ *
+ * We advice to use the filter using the Elias-Fano data structure, since it is the most efficient one and is the
+ * one proposed in the paper. However, any data structure that is either iterable or supports the following operations
+ * can be used:
+ *  - check_presence(a, b): returns true if it exists an element 'x' in the set such that 'a <= x <= b'. False otherwise.
+ *  - check_presence(a): returns true if it exists an element 'x' in the set such that 'x == a'. False otherwise.
+ *  - size(): returns the size of the data structure in bytes.
+ *
+ * If using the Elias-Fano data structure we proved the following bounds:
+ *  - The space complexity is 'n * log(L/eps) + 2n + o(n)' bits (i.e. 2 bpk more than the lower bound).
+ *  - The query time is 'O(log(L/eps))'. If setting a constant space budget 'b', the query time is 'O(b) = O(1)'.
+ *
+ * NOTE: the vector of hashed elements passed to RangeEmptinessDS may have duplicated elements (due to the hashing
+ *       collision). The RangeEmptinessDS should handle this case. In fact, it must be disabled if the user cares
+ *       about the approximate range count. Otherwise, it can be approximated using the formula
+ *       'approx number of collisions = n*eps/(2L)'.
+ *
+ * If available (and enabled at compile time) this data structure makes use of the Boost library and/or multithreading
+ * to speed-up the sorting algorithm. The user can enable/disable these features by defining the macros:
+ *  - USE_LIBRARY_BOOST_PARALLEL: enables the use of the Boost library in multithreading.
+ *  - USE_LIBRARY_BOOST: enables the use of the Boost library in single thread.
+ *  - USE_LIBRARY_STL_PARALLEL: enables the use of the standard library in multithreading.
+ * The sort algorithm is picked at runtime by the number of keys and the thread budget, unless it is fixed by the
+ * grafite::build_options passed to the constructor (see grafite::sort_backend). If a grafite::build_executor is set
+ * (see grafite::set_build_executor), the hashing and the parallel sort are split into tasks run by the executor, so
+ * that concurrent constructions share the same threads. The end of each phase of the construction is reported to the
+ * 'on_phase_end' callback of the options, if set (see grafite::build_phase).
+ *
+ * If 'pow2_universe' is set, the size of the reduced universe 'r' is rounded up to the next power of two, so that the
+ * hash function computes 'x / r' and the final '% r' with a shift and a mask, and the only division left in the query
+ * path is the reduction modulo 'p'. The rounding increases the space by less than one bit per key (log2 of the
+ * rounding factor) and decreases the FPR by the same factor.
+ *
+ * Defining GRAFITE_QUERY_STATS enables the counters of the exits of the query methods and of the latency of the
+ * hashing and of the container probes (see grafite::query_stats).
+ *
+ * The hash function is a policy (see grafite::modular_hash, the default, grafite::multiply_shift_hash and
+ * grafite::keyed_hash), which draws, stores and serializes its own parameters. Note that the policy decides the size of
+ * the reduced universe, thus 'pow2_universe' only affects the default policy.
+ *
+ * @tparam RangeEmptinessDS the data structure used to check the emptiness of a range.
+ * @tparam default_bpk_overhead the default number of bits per key overhead used by the data structure used to
+ *                              check the emptiness of a range.
+ * @tparam pow2_universe if true, the size of the reduced universe is rounded up to a power of two.
+ * @tparam HashPolicy the locality-preserving hash function used to map the keys to the reduced universe.
+ */
+#if defined(SUCCINCT_LIB_SUX)
+template <class RangeEmptinessDS = ef_sux_vector, unsigned int default_bpk_overhead = 2, bool pow2_universe = false,
+          class HashPolicy = modular_hash<pow2_universe>>
+#elif defined(SUCCINCT_LIB_SDSL)
+template <class RangeEmptinessDS = ef_sdsl_vector, unsigned int default_bpk_overhead = 2, bool pow2_universe = false,
+          class HashPolicy = modular_hash<pow2_universe>>
+#else
+template <class RangeEmptinessDS, unsigned int default_bpk_overhead = 0, bool pow2_universe = false,
+          class HashPolicy = modular_hash<pow2_universe>>
+#endif
+class filter
+{
+protected:
+    using value_type = uint64_t; /* the type of the elements in the set */
+
+    RangeEmptinessDS ds; /* the container data structure used to check the emptiness of a range */
+    HashPolicy hash_policy; /* the hash function and its parameters */
+    value_type r = 1, n_items = 0; /* the parameters of the data structure */
+
+    /* the first and last element of the set, an empty filter has 'first > last' so that every query exits early */
+    value_type first = std::numeric_limits<value_type>::max(), last = 0;
+
+    /**
+     * @brief Hashes the input value with the hash policy, by default using the formula: '(((a * (x / r) + b) % p) + x) % r'.
+     *
+     * This function is used to map the elements of the set to the range [0, r), where 'r' is the size of the reduced
+     * universe.
+     *
+     * @tparam T the type of the input value (must be an arithmetic type)
+     * @param x the input value
+     * @return the hashed value
+     */
+    template <class T, class = typename std::enable_if<std::is_arithmetic<T>::value, T>::type>
+    inline value_type hash(const T x) const
+    {
+        return hash_policy(x, r);
+    }
+
+#ifdef SUCCINCT_LIB_SDSL
+    template <class Q = RangeEmptinessDS>
+    class std::enable_if<std::is_same<Q, sdsl::int_vector<0>>::value, void>::type
+    compress()
+    {
+        sdsl::util::bit_compress(ds);
+    }
+#endif
+
+    /**
+     * Main constructor for the grafite::filter class. It takes as input a range of elements and the size of the reduced
+     * universe r (see the paper for more details). The constructor computes the parameters of the data structure and
+     * builds the filter.
+     *
+     * Note that if the maximum element in the input range is smaller than 'r', the constructor will throw an exception.
+     * In fact, this is means to construct an approximate range filter such that its size in bits per key is greater
+     * that the size of a lossless encoding of the input keys without any approximation (which occupies log2(u/n) + 2 bpk).
+     *
+     * @tparam t_itr the type of the iterator used to iterate over the input range
+     * @param r the size of the reduced universe
+     * @param begin the iterator to the first element of the input range
+     * @param end the iterator to the last element of the input range
+     * @param options the options of the construction, such as the sort algorithm (see grafite::build_options)
+     */
+    template <class t_itr>
+    filter(const value_type _r, const t_itr begin, const t_itr end, const build_options &options = {})
+            : ds(), hash_policy(), r(std::max<value_type>(1, HashPolicy::universe(_r))), n_items(std::distance(begin, end))
+    {
+        if (begin == end)
+            return;
+        hash_policy.init(r);
+
+        auto *executor = build_executor::global().load();
+        auto phase_end = [&](const build_phase phase) {
+            if (options.on_phase_end)
+                options.on_phase_end(phase);
+        };
+
+        /*
+         * The following code hashes the input elements into the temporary vector and computes the maximum element in
+         * the input range (since the input is not required to be sorted). If a build executor is set, each task
+         * processes a chunk of the input. The two are fused in a single pass over the input, which hashes each block of
+         * a chunk and then scans it while it is still in cache, unless the phases are reported to 'on_phase_end': then
+         * the maximum is computed by a separate pass before the hashing, so that the two are measured apart.
+         */
+        using key_type = typename std::iterator_traits<t_itr>::value_type;
+        const size_t n_chunks = executor ? std::max<size_t>(1, std::min(executor->concurrency(), (size_t) (n_items >> 16))) : 1;
+        auto chunk_begin = [&](const size_t c) { return (c * n_items) / n_chunks; };
+        auto run_chunks = [&](const std::function<void(size_t)> &task) {
+            if (executor)
+                executor->run(n_chunks, task);
+            else
+                task(0);
+        };
+
+        std::vector<key_type> chunk_max(n_chunks, 0);
+        auto max_input_key = [&] { return *std::max_element(chunk_max.begin(), chunk_max.end()); };
+        auto check_max_input_key = [&] {
+            if (max_input_key() < this->r) /* equivalent to bpk > 2 + log2(u/n) */
+                throw std::runtime_error("error, the requested bpk is higher than a lossless compressed encoding of the input data");
+        };
+
+        std::vector<value_type> temp;
+        if (options.on_phase_end)
+        {
+            run_chunks([&](size_t c) {
+                chunk_max[c] = *std::max_element(std::next(begin, chunk_begin(c)), std::next(begin, chunk_begin(c + 1)));
+            });
+            phase_end(build_phase::max_key_scan);
+            check_max_input_key();
+
+            temp.resize(n_items);
+            run_chunks([&](size_t c) {
+                hash_policy(std::next(begin, chunk_begin(c)), std::next(begin, chunk_begin(c + 1)), temp.begin() + chunk_begin(c), r);
+            });
+            phase_end(build_phase::hashing);
+        }
+        else
+        {
+            constexpr size_t block_size = 1 << 12;
+            temp.resize(n_items);
+            run_chunks([&](size_t c) {
+                auto block = std::next(begin, chunk_begin(c));
+                for (auto i = chunk_begin(c), chunk_end = chunk_begin(c + 1); i < chunk_end; i += block_size)
+                {
+                    auto block_end = std::next(block, std::min(block_size, chunk_end - i));
+                    hash_policy(block, block_end, temp.begin() + i, r);
+                    chunk_max[c] = std::max(chunk_max[c], *std::max_element(block, block_end));
+                    block = block_end;
+                }
+            });
+            check_max_input_key();
+        }
+
+        sort_keys(temp, value_type(r - 1), options);
+        phase_end(build_phase::sort);
+
+        first = temp.front(), last = temp.back();
+        ds = RangeEmptinessDS{temp.begin(), temp.end()};
+
+#ifdef SUCCINCT_LIB_SDSL
+        if constexpr (std::is_same_v<RangeEmptinessDS, sdsl::int_vector<>>)
+            compress();
+#endif
+        phase_end(build_phase::encoding);
+    }
+
+public:
+
+    filter() = default;
+
+    /**
+     * @brief This constructor allows to specify the false positive rate 'eps' desired for the range queries of size 'L'.
+     * The size of the reduced universe r is calculated as r = (n * L)/eps, where 'n' is the number of elements in the input
+     * range. The false positive rate for a range query of size 'l' is bounded by the formula 'eps_l = (l * eps)/L'.
+     *
+     * @tparam t_itr the iterator type
+     * @param begin the start iterator of the input keys
+     * @param end the end iterator of the input keys
+     * @param eps the false positive rate desired for the range queries of size 'L'
+     * @param L the maximum range size for which the false positive rate is guaranteed
+     * @param options the options of the construction (see grafite::build_options)
+     */
+    template <class t_itr>
+    filter(const t_itr begin, const t_itr end, const double eps,
+           const typename std::iterator_traits<t_itr>::value_type L, const build_options &options = {})
+            : filter((std::distance(begin, end) * L) / eps, begin, end, options) {}
+
+
+    /**
+     * @brief This constructor allows to specify the number of bits per key (bpk) desired.
+     * The size of the reduced universe r is calculated as r = n * 2^(bpk - overhead). The overhead is a parameter that can be specified as
+     * a template argument by the user and represents the overhead, in bits per key, of the underlying container data
+     * structure with respect to the optimal space consumption of log2(r/n) bits per key. The overhead for the
+     * Elias-Fano data structure is 2. The false positive rate for a range query of size 'l' is bounded by the formula
+     * 'eps_l = l/2^(bpk - overhead)'.
+     *
+     * @tparam t_itr the iterator type
+     * @param begin the start iterator of the input keys
+     * @param end the end iterator of the input keys
+     * @param bpk the desired bits per key (bpk) occupied by the filter
+     * @param options the options of the construction (see grafite::build_options)
      */
     template <class t_itr>
-    filter(const t_itr begin, const t_itr end, const double eps, const typename t_itr::value_type L)
-            : filter((std::distance(begin, end) * L) / eps, begin, end) {}
+    filter(const t_itr begin, const t_itr end, const double bpk, const build_options &options = {})
+            : filter(std::ceil(std::distance(begin, end) * std::exp2(bpk - default_bpk_overhead)), begin, end, options) {}
+
+
+    filter (filter &&rf) noexcept
+    {
+        ds = std::move(rf.ds);
+        first = std::move(rf.first);
+        last = std::move(rf.last);
+        n_items = std::move(rf.n_items);
+        hash_policy = std::move(rf.hash_policy);
+        r = std::move(rf.r);
+    }
+
+    filter& operator=(filter &&rf) noexcept
+    {
+        if (this != &rf)
+        {
+            ds = std::move(rf.ds);
+            first = std::move(rf.first);
+            last = std::move(rf.last);
+            n_items = std::move(rf.n_items);
+            hash_policy = std::move(rf.hash_policy);
+            r = std::move(rf.r);
+        }
+
+        return *this;
+    }
+
+    /**
+     * @brief Batch range query method for the Grafite range filter.
+     * Checks the ranges [*l_begin, *r_begin], [*(l_begin + 1), *(r_begin + 1)], ... and writes the results into 'out'.
+     * The loop, together with the hashing and the container queries inlined into it, is compiled for each CPU level
+     * (see GRAFITE_MULTIVERSION).
+     *
+     * @param l_begin the begin iterator of the left endpoints
+     * @param l_end the end iterator of the left endpoints
+     * @param r_begin the begin iterator of the right endpoints
+     * @param out the output iterator of the results
+     */
+    template <class l_itr, class r_itr, class o_itr>
+    GRAFITE_MULTIVERSION void query(l_itr l_begin, const l_itr l_end, r_itr r_begin, o_itr out) const
+    {
+        for (; l_begin != l_end; ++l_begin, ++r_begin, ++out)
+            *out = query(*l_begin, *r_begin);
+    }
+
+    /**
+     * @brief Range query method for the Grafite range filter.
+     * Both query endpoints are inclusive, i.e. [left, right]. The expected false positive rate is (right - left)*n/r.
+     *
+     * @param left the left endpoint, inclusive
+     * @param right the right endpoint, inclusive
+     * @return tt if a key possibly intersects the range, ff if a key definitely does not
+     */
+    template <class T>
+    bool query(const T left, const T right) const
+    {
+        if (right < left)
+            throw std::runtime_error("range parameters are not sorted");
+        if (left == right)
+            return query(left);
+
+        auto hash_left = GRAFITE_TIMED(hash, hash(left)), hash_right = GRAFITE_TIMED(hash, hash(right));
+
+        if (hash_left > hash_right)
+            return GRAFITE_QUERY_PATH(range_wrap_around, ((first <= hash_right) || (last >= hash_left)));
+        else if ((hash_left > last) || (hash_right < first))
+            return GRAFITE_QUERY_PATH(range_outside, false);
+        else if (hash_right > last)
+            return GRAFITE_QUERY_PATH(range_right_overlap, (hash_left <= last));
+        else if (hash_left < first)
+            return GRAFITE_QUERY_PATH(range_left_overlap, (first <= hash_right));
+
+        /**
+         * We verify if the container data structure is iterable. In this case we apply the std::lower_bound method
+         * to verify if exists a certain key 'x' in the range [h(left), h(right)], otherwise we use the method
+         * 'check_presence' provided by the user container class.
+         */
+        if constexpr (is_iterable_v<RangeEmptinessDS>)
+        {
+            auto next = GRAFITE_TIMED(probe, std::lower_bound(ds.begin(), ds.end(), hash_left));
+            return GRAFITE_QUERY_PATH(range_probe, (next != ds.end()) && (*next <= hash_right));
+        }
+
+        return GRAFITE_QUERY_PATH(range_probe, GRAFITE_TIMED(probe, ds.check_presence(hash_left, hash_right)));
+    }
+
+    /**
+     * @brief Point query method for the Grafite range filter.
+     * The expected false positive rate is n/r.
+     *
+     * @param k the key to query
+     * @return tt if the key possibly intersects in the set, ff if definitely does not
+     */
+    template <class T>
+    bool query(const T k) const
+    {
+        auto hash_k = GRAFITE_TIMED(hash, hash(k));
+
+        if ((hash_k > last) || (hash_k < first))
+            return GRAFITE_QUERY_PATH(point_outside, false);
+
+        /**
+         * We verify if the container data structure is iterable. In this case we apply the std::lower_bound method
+         * to verify if hash(k) is in the set, otherwise we use the method 'check_presence' provided by the user
+         * container class.
+         */
+        if constexpr (is_iterable_v<RangeEmptinessDS>)
+        {
+            auto v = GRAFITE_TIMED(probe, std::lower_bound(ds.begin(), ds.end(), hash_k));
+            return GRAFITE_QUERY_PATH(point_probe, (v != ds.end()) && (*v == hash_k));
+        }
+
+        return GRAFITE_QUERY_PATH(point_probe, GRAFITE_TIMED(probe, ds.check_presence(hash_k)));
+    }
+
+    /**
+     * @brief Returns the expected false positive rate of the range queries of 'length' keys, i.e. 'min(1, length * n/r)'.
+     */
+    [[nodiscard]] double expected_fpr(const value_type length) const
+    {
+        return r == 0 ? 0 : std::min(1.0, double(length) * n_items / r);
+    }
+
+    /**
+     * @brief Returns the size in bytes of the Grafite range filter.
+     * The expected size of the grafite range filter is n * bpk bits. Where bpk can be calculated as
+     * bpk = log2(r/n) + overhead, where r is the size of the reduced universe and overhead is the overhead of the
+     * underlying container data structure (2 with Elias-Fano).
+     *
+     * @return the size in bytes of the Grafite range filter
+     */
+    auto size() const
+    {
+        if constexpr (is_vector<RangeEmptinessDS>())
+            return sizeof(filter) + (ds.size() * sizeof(value_type));
+#ifdef SUCCINCT_LIB_SDSL
+        else if constexpr (std::is_same_v<RangeEmptinessDS, sdsl::int_vector<>>)
+            return sizeof(filter) + sdsl::size_in_bytes(ds);
+#endif
+        return sizeof(filter) + ds.size();
+    }
+
+    /**
+     * @brief Returns the memory used by the Grafite range filter, broken down into its components (see
+     * grafite::memory_report). The header includes the parameters of the hash function.
+     */
+    [[nodiscard]] grafite::memory_report memory_report() const
+    {
+        auto m = container_memory_report(ds);
+        m.header_bytes += sizeof(filter) - sizeof(ds);
+        return m;
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const filter &rf)
+    {
+        out.write(reinterpret_cast<const char *>(&rf.first), sizeof(rf.first));
+        out.write(reinterpret_cast<const char *>(&rf.last), sizeof(rf.last));
+        out.write(reinterpret_cast<const char *>(&rf.n_items), sizeof(rf.n_items));
+        out << rf.hash_policy;
+        out.write(reinterpret_cast<const char *>(&rf.r), sizeof(rf.r));
+        out << rf.ds;
+        return out;
+    }
+
+    friend std::istream &operator>>(std::istream &in, filter &rf)
+    {
+        in.read(reinterpret_cast<char *>(&rf.first), sizeof(rf.first));
+        in.read(reinterpret_cast<char *>(&rf.last), sizeof(rf.last));
+        in.read(reinterpret_cast<char *>(&rf.n_items), sizeof(rf.n_items));
+        in >> rf.hash_policy;
+        in.read(reinterpret_cast<char *>(&rf.r), sizeof(rf.r));
+        in >> rf.ds;
+        return in;
+    }
+
+};
+
+/**
+ * Tags used to select the grafite range filter specialized for a query type through grafite::filter_for.
+ */
+struct range_query_tag {};
+struct point_query_tag {};
+
+/**
+ * The grafite::point_filter class is a specialization of the grafite::filter class for workloads made only of point
+ * queries. It shares the construction, the hashing and the serialization format of grafite::filter, but it answers a
+ * point query with a single probe to the container through its method 'check_membership(x)', which checks if 'x' is
+ * in the set, rather than with the two rank operations of 'check_presence(x, x)'. Containers without such method
+ * fall back to 'check_presence(x)'.
+ *
+ * The Elias-Fano containers already store the hashed values in a quotiented layout, where the upper bits are the
+ * quotient (encoded in unary) and the lower bits the remainder, thus the membership is resolved by a predecessor query
+ * (ef_sux_vector) or by a single access to the sparse bitvector (ef_sdsl_vector).
+ *
+ * The range query method is not available, since range queries are what grafite::filter is for.
+ *
+ * @tparam RangeEmptinessDS the data structure used to store the hashed keys.
+ * @tparam default_bpk_overhead the default number of bits per key overhead of the data structure.
+ * @tparam pow2_universe if true, the size of the reduced universe is rounded up to a power of two.
+ * @tparam HashPolicy the hash function used to map the keys to the reduced universe (see grafite::filter).
+ */
+#if defined(SUCCINCT_LIB_SUX)
+template <class RangeEmptinessDS = ef_sux_vector, unsigned int default_bpk_overhead = 2, bool pow2_universe = false,
+          class HashPolicy = modular_hash<pow2_universe>>
+#elif defined(SUCCINCT_LIB_SDSL)
+template <class RangeEmptinessDS = ef_sdsl_vector, unsigned int default_bpk_overhead = 2, bool pow2_universe = false,
+          class HashPolicy = modular_hash<pow2_universe>>
+#else
+template <class RangeEmptinessDS, unsigned int default_bpk_overhead = 0, bool pow2_universe = false,
+          class HashPolicy = modular_hash<pow2_universe>>
+#endif
+class point_filter : public filter<RangeEmptinessDS, default_bpk_overhead, pow2_universe, HashPolicy>
+{
+private:
+    using base = filter<RangeEmptinessDS, default_bpk_overhead, pow2_universe, HashPolicy>;
+
+public:
+    using base::base;
+
+    point_filter() = default;
+
+    /**
+     * @brief Point query method for the Grafite point filter.
+     * The expected false positive rate is n/r.
+     *
+     * @param k the key to query
+     * @return tt if the key possibly intersects in the set, ff if definitely does not
+     */
+    template <class T>
+    bool query(const T k) const
+    {
+        auto hash_k = GRAFITE_TIMED(hash, this->hash(k));
+
+        if ((hash_k > this->last) || (hash_k < this->first))
+            return GRAFITE_QUERY_PATH(point_outside, false);
+
+        if constexpr (has_check_membership_v<RangeEmptinessDS>)
+            return GRAFITE_QUERY_PATH(point_probe, GRAFITE_TIMED(probe, this->ds.check_membership(hash_k)));
+        else if constexpr (is_iterable_v<RangeEmptinessDS>)
+            return GRAFITE_QUERY_PATH(point_probe, GRAFITE_TIMED(probe, std::binary_search(this->ds.begin(), this->ds.end(), hash_k)));
+        else
+            return GRAFITE_QUERY_PATH(point_probe, GRAFITE_TIMED(probe, this->ds.check_presence(hash_k)));
+    }
+};
+
+/**
+ * Selects grafite::filter or grafite::point_filter given a query tag, e.g. 'filter_for<point_query_tag>'. The other
+ * template parameters are forwarded to the selected class.
+ */
+#if defined(SUCCINCT_LIB_SUX)
+template <class QueryTag, class RangeEmptinessDS = ef_sux_vector, unsigned int default_bpk_overhead = 2,
+          bool pow2_universe = false, class HashPolicy = modular_hash<pow2_universe>>
+#elif defined(SUCCINCT_LIB_SDSL)
+template <class QueryTag, class RangeEmptinessDS = ef_sdsl_vector, unsigned int default_bpk_overhead = 2,
+          bool pow2_universe = false, class HashPolicy = modular_hash<pow2_universe>>
+#else
+template <class QueryTag, class RangeEmptinessDS, unsigned int default_bpk_overhead = 0, bool pow2_universe = false,
+          class HashPolicy = modular_hash<pow2_universe>>
+#endif
+using filter_for = std::conditional_t<std::is_same_v<QueryTag, point_query_tag>,
+        point_filter<RangeEmptinessDS, default_bpk_overhead, pow2_universe, HashPolicy>,
+        filter<RangeEmptinessDS, default_bpk_overhead, pow2_universe, HashPolicy>>;
+
+/**
+ * Returns the size of the reduced universe 'r = (n * L)/eps' of a range filter on 'n' keys with false positive rate
+ * 'eps' for range queries of size 'L'. Since the function is constexpr, it can be used to compute the first template
+ * parameter of grafite::static_filter.
+ */
+constexpr uint64_t reduced_universe_size(const uint64_t n, const uint64_t L, const double eps)
+{
+    return static_cast<uint64_t>((n * L) / eps);
+}
+
+/**
+ * The grafite::static_filter class is a variant of the grafite::filter class whose size of the reduced universe 'R'
+ * and hash constants 'A' and 'B' are template parameters. Thus, the compiler folds the divisions and the modulo
+ * operations of the hash function into multiplications by constants, and the filter stores only its container data
+ * structure, without the runtime header of grafite::filter (the parameters, the number of keys and the first and last
+ * hashed values). This makes it suitable for tiny filters embedded in other data structures, e.g. the nodes of a
+ * B-tree, when the parameters are known at compile time (see grafite::reduced_universe_size).
+ *
+ * The constants must satisfy '0 < A < R' and 'B < R', and should be drawn at random for the FPR guarantee of the
+ * hash function to hold, e.g. once per build of the application. The FPR for range queries of size 'l' is '(l * n)/R'.
+ *
+ * @tparam R the size of the reduced universe
+ * @tparam A the multiplicative constant of the hash function
+ * @tparam B the additive constant of the hash function
+ * @tparam RangeEmptinessDS the data structure used to check the emptiness of a range.
+ */
+#if defined(SUCCINCT_LIB_SUX)
+template <uint64_t R, uint64_t A, uint64_t B, class RangeEmptinessDS = ef_sux_vector>
+#elif defined(SUCCINCT_LIB_SDSL)
+template <uint64_t R, uint64_t A, uint64_t B, class RangeEmptinessDS = ef_sdsl_vector>
+#else
+template <uint64_t R, uint64_t A, uint64_t B, class RangeEmptinessDS>
+#endif
+class static_filter
+{
+private:
+    using value_type = uint64_t;
+
+    constexpr static value_type p = (1UL << 61) - 1UL; /* a huge prime */
 
+    static_assert(R > 0, "the size of the reduced universe must be positive");
+    static_assert(A > 0 && A < R && B < R, "the hash constants must satisfy 0 < A < R and B < R");
+
+    RangeEmptinessDS ds;
 
     /**
-     * @brief This constructor allows to specify the number of bits per key (bpk) desired.
-     * The size of the reduced universe r is calculated as r = n * 2^(bpk - overhead). The overhead is a parameter that can be specified as
-     * a template argument by the user and represents the overhead, in bits per key, of the underlying container data
-     * structure with respect to the optimal space consumption of log2(r/n) bits per key. The overhead for the
-     * Elias-Fano data structure is 2. The false positive rate for a range query of size 'l' is bounded by the formula
-     * 'eps_l = l/2^(bpk - overhead)'.
+     * @brief Hashes the input value using the formula: '(((A * (x / R) + B) % p) + x) % R', where all the constants are
+     * known at compile time.
+     */
+    template <class T, class = typename std::enable_if<std::is_arithmetic<T>::value, T>::type>
+    static inline value_type hash(const T x)
+    {
+        return (((A * (value_type(x) / R) + B) % p) + value_type(x)) % R;
+    }
+
+    inline bool contains(const value_type a, const value_type b) const
+    {
+        if constexpr (is_iterable_v<RangeEmptinessDS>)
+        {
+            auto next = std::lower_bound(ds.begin(), ds.end(), a);
+            return (next != ds.end()) && (*next <= b);
+        }
+        else
+            return ds.check_presence(a, b);
+    }
+
+public:
+    static_filter() = default;
+
+    /**
+     * @brief Constructs the filter from the input keys, which are not required to be sorted.
      *
      * @tparam t_itr the iterator type
      * @param begin the start iterator of the input keys
      * @param end the end iterator of the input keys
-     * @param bpk the desired bits per key (bpk) occupied by the filter
      */
     template <class t_itr>
-    filter(const t_itr begin, const t_itr end, const double bpk)
-            : filter(std::ceil(std::distance(begin, end) * std::exp2(bpk - default_bpk_overhead)), begin, end) {}
+    static_filter(const t_itr begin, const t_itr end)
+    {
+        if (begin == end)
+            return;
 
+        std::vector<value_type> temp(std::distance(begin, end));
+        std::transform(begin, end, temp.begin(), [](auto x) { return hash(x); });
+        std::sort(temp.begin(), temp.end());
+        ds = RangeEmptinessDS{temp.begin(), temp.end()};
+    }
 
-    filter (filter &&rf) noexcept
+    static_filter(static_filter &&sf) noexcept
     {
-        ds = std::move(rf.ds);
-        first = std::move(rf.first);
-        last = std::move(rf.last);
-        n_items = std::move(rf.n_items);
-        a = std::move(rf.a);
-        b = std::move(rf.b);
-        r = std::move(rf.r);
+        ds = std::move(sf.ds);
     }
 
-    filter& operator=(filter &&rf) noexcept
+    static_filter &operator=(static_filter &&sf) noexcept
     {
-        if (this != &rf)
-        {
-            ds = std::move(rf.ds);
-            first = std::move(rf.first);
-            last = std::move(rf.last);
-            n_items = std::move(rf.n_items);
-            a = std::move(rf.a);
-            b = std::move(rf.b);
-            r = std::move(rf.r);
-        }
-
+        if (this != &sf)
+            ds = std::move(sf.ds);
         return *this;
     }
 
     /**
-     * @brief Range query method for the Grafite range filter.
-     * Both query endpoints are inclusive, i.e. [left, right]. The expected false positive rate is (right - left)*n/r.
+     * @brief Range query method for the static Grafite range filter.
+     * Both query endpoints are inclusive, i.e. [left, right]. The expected false positive rate is (right - left)*n/R.
      *
      * @param left the left endpoint, inclusive
      * @param right the right endpoint, inclusive
@@ -589,37 +1974,16 @@ public:
     {
         if (right < left)
             throw std::runtime_error("range parameters are not sorted");
-        if (left == right)
-            return query(left);
 
         auto hash_left = hash(left), hash_right = hash(right);
-
         if (hash_left > hash_right)
-            return ((first <= hash_right) || (last >= hash_left));
-        else if ((hash_left > last) || (hash_right < first))
-            return false;
-        else if (hash_right > last)
-            return (hash_left <= last);
-        else if (hash_left < first)
-            return (first <= hash_right);
-
-        /**
-         * We verify if the container data structure is iterable. In this case we apply the std::lower_bound method
-         * to verify if exists a certain key 'x' in the range [h(left), h(right)], otherwise we use the method
-         * 'check_presence' provided by the user container class.
-         */
-        if constexpr (is_iterable_v<RangeEmptinessDS>)
-        {
-            auto next = std::lower_bound(ds.begin(), ds.end(), hash_left);
-            return (next != ds.end()) && (*next <= hash_right);
-        }
-
-        return ds.check_presence(hash_left, hash_right);
+            return contains(0, hash_right) || contains(hash_left, R - 1);
+        return contains(hash_left, hash_right);
     }
 
     /**
-     * @brief Point query method for the Grafite range filter.
-     * The expected false positive rate is n/r.
+     * @brief Point query method for the static Grafite range filter.
+     * The expected false positive rate is n/R.
      *
      * @param k the key to query
      * @return tt if the key possibly intersects in the set, ff if definitely does not
@@ -628,77 +1992,353 @@ public:
     bool query(const T k) const
     {
         auto hash_k = hash(k);
+        return contains(hash_k, hash_k);
+    }
 
-        if ((hash_k > last) || (hash_k < first))
-            return false;
+    /**
+     * @brief Returns the size in bytes of the static Grafite range filter, i.e. the size of its container.
+     */
+    auto size() const
+    {
+        if constexpr (is_vector<RangeEmptinessDS>())
+            return sizeof(static_filter) + (ds.size() * sizeof(value_type));
+        return sizeof(static_filter) + ds.size();
+    }
 
-        /**
-         * We verify if the container data structure is iterable. In this case we apply the std::lower_bound method
-         * to verify if hash(k) is in the set, otherwise we use the method 'check_presence' provided by the user
-         * container class.
+    /**
+     * @brief Returns the memory used by the static Grafite range filter, i.e. the memory report of its container.
+     */
+    [[nodiscard]] grafite::memory_report memory_report() const
+    {
+        auto m = container_memory_report(ds);
+        m.header_bytes += sizeof(static_filter) - sizeof(ds);
+        return m;
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const static_filter &sf)
+    {
+        out << sf.ds;
+        return out;
+    }
+
+    friend std::istream &operator>>(std::istream &in, static_filter &sf)
+    {
+        in >> sf.ds;
+        return in;
+    }
+};
+
+/**
+ * The grafite::hybrid_filter class partitions the key space into ranges containing the same number of keys and
+ * encodes each partition with either a grafite::bucket or a grafite::filter. The grafite::bucket is faster and smaller
+ * on partitions whose keys are evenly spread, while the grafite::filter guarantees its FPR on the partitions where the
+ * keys are clustered, i.e. where the queries close to a key would hit a non-empty bucket.
+ *
+ * The encoding of each partition is chosen either by a query sample, comparing the FPR of the grafite::bucket on the
+ * sample (computed by emulating its bucketing over the keys) with the expected FPR of the grafite::filter, or, if no
+ * sample is given, by the local density of the keys, measured as the coefficient of variation of the gaps between
+ * consecutive keys. Keys drawn uniformly at random have exponentially distributed gaps, with a coefficient of variation
+ * of 1, while clustered keys have much higher values.
+ *
+ * A small directory of the first key of each partition routes the queries to the partitions they intersect. The
+ * grafite::bucket partitions store their keys relative to the beginning of the partition, so that the size of the
+ * buckets depends only on the local universe.
+ *
+ * @tparam RangeEmptinessDS the container data structure of the grafite::filter partitions
+ * @tparam EliasFanoDS the container data structure of the grafite::bucket partitions
+ */
+#if defined(SUCCINCT_LIB_SUX)
+template <class RangeEmptinessDS = ef_sux_vector, class EliasFanoDS = ef_sux_vector>
+#elif defined(SUCCINCT_LIB_SDSL)
+template <class RangeEmptinessDS = ef_sdsl_vector, class EliasFanoDS = ef_sdsl_vector>
+#else
+template <class RangeEmptinessDS, class EliasFanoDS>
+#endif
+class hybrid_filter
+{
+private:
+    using value_type = uint64_t;
+    using filter_type = filter<RangeEmptinessDS>;
+    using bucket_type = bucket<EliasFanoDS>;
+
+    constexpr static uint32_t bucket_flag = 1U << 31; /* marks the partitions encoded with a grafite::bucket */
+
+    std::vector<value_type> bounds; /* the first key of each partition, the first partition starts at 0 */
+    std::vector<uint32_t> slots; /* the index of each partition in either 'filters' or 'buckets' */
+    std::vector<filter_type> filters;
+    std::vector<bucket_type> buckets;
+
+    /**
+     * Returns the coefficient of variation of the gaps between the consecutive keys in [begin, end).
+     */
+    template <class t_itr>
+    static double gaps_cv(const t_itr begin, const t_itr end)
+    {
+        auto m = std::distance(begin, end);
+        if (m < 3)
+            return 0;
+        auto mean = (double) (*(end - 1) - *begin) / (m - 1);
+        double var = 0;
+        for (auto it = begin + 1; it < end; ++it)
+        {
+            auto d = (double) (*it - *(it - 1)) - mean;
+            var += d * d;
+        }
+        return (mean > 0) ? std::sqrt(var / (m - 1)) / mean : 0;
+    }
+
+    /**
+     * Returns true if the grafite::bucket is expected to have an FPR not higher than the grafite::filter on the
+     * empty queries of the sample which fall in the partition [begin, end) starting at 'base'.
+     */
+    template <class t_itr>
+    static bool bucket_wins(const t_itr begin, const t_itr end, const value_type base, const double bpk,
+                            const std::vector<std::pair<value_type, value_type>> &queries)
+    {
+        const auto m = std::distance(begin, end);
+        const auto s = std::max<value_type>(1, std::ceil((double) (*(end - 1) - base + 1) / (m * std::exp2(bpk - 2))));
+        const auto r = std::ceil(m * std::exp2(bpk - 2));
+        double filter_fp = 0;
+        uint64_t bucket_fp = 0;
+        for (auto [left, right] : queries)
+        {
+            auto lo = base + ((left - base) / s) * s, hi = base + ((right - base) / s) * s;
+            hi = (std::numeric_limits<value_type>::max() - hi < s - 1) ? std::numeric_limits<value_type>::max() : hi + s - 1;
+            auto it = std::lower_bound(begin, end, lo);
+            bucket_fp += (it != end) && (*it <= hi);
+            filter_fp += std::min(1.0, (double) (right - left + 1) * m / r);
+        }
+        return bucket_fp <= filter_fp;
+    }
+
+    template <class t_itr, class ChooseFun>
+    void build(const t_itr begin, const t_itr end, const double bpk, const size_t partition_size, ChooseFun choose)
+    {
+        if (begin == end)
+            return;
+        if (!std::is_sorted(begin, end))
+            throw std::runtime_error("error, the input is not sorted");
+        if (partition_size == 0)
+            throw std::runtime_error("error, the requested partition size is < 1");
+
+        const auto n = (size_t) std::distance(begin, end);
+        const auto n_partitions = (n + partition_size - 1) / partition_size;
+        bounds.reserve(n_partitions);
+        slots.reserve(n_partitions);
+
+        std::vector<value_type> shifted;
+        for (size_t i = 0; i < n_partitions; ++i)
+        {
+            auto p_begin = begin + i * partition_size;
+            auto p_end = begin + std::min(n, (i + 1) * partition_size);
+            const value_type base = (i == 0) ? 0 : *p_begin;
+            bounds.push_back(base);
+
+            /*
+             * The grafite::filter throws if the keys of the partition can be encoded losslessly in less space, in this
+             * case the grafite::bucket is used since its buckets have size 1.
+             */
+            const auto filter_feasible = *(p_end - 1) >= std::ceil(std::distance(p_begin, p_end) * std::exp2(bpk - 2));
+            if (filter_feasible && !choose(p_begin, p_end, base))
+            {
+                slots.push_back(filters.size());
+                filters.emplace_back(p_begin, p_end, bpk);
+            }
+            else
+            {
+                shifted.resize(std::distance(p_begin, p_end));
+                std::transform(p_begin, p_end, shifted.begin(), [base](auto x) { return x - base; });
+                slots.push_back(buckets.size() | bucket_flag);
+                buckets.emplace_back(shifted.begin(), shifted.end(), bpk);
+            }
+        }
+    }
+
+    inline bool query_partition(const size_t i, const value_type left, const value_type right) const
+    {
+        if (slots[i] & bucket_flag)
+            return buckets[slots[i] & ~bucket_flag].query(left - bounds[i], right - bounds[i]);
+        return filters[slots[i]].query(left, right);
+    }
+
+public:
+    hybrid_filter() = default;
+
+    /**
+     * Constructs the hybrid filter from a sorted range of integers, choosing the encoding of each partition by the
+     * local density of the keys.
+     *
+     * @tparam t_itr the type of the iterator
+     * @param begin the beginning of the sorted range of keys
+     * @param end the end of the sorted range of keys
+     * @param bpk the desired number of bits per key of each partition
+     * @param partition_size the number of keys in each partition
+     * @param max_gaps_cv the maximum coefficient of variation of the gaps for a partition to be encoded with a bucket
+     */
+    template <class t_itr>
+    hybrid_filter(const t_itr begin, const t_itr end, const double bpk, const size_t partition_size = 1 << 16,
+                  const double max_gaps_cv = 1.5)
+    {
+        build(begin, end, bpk, partition_size, [&](auto p_begin, auto p_end, auto) {
+            return gaps_cv(p_begin, p_end) <= max_gaps_cv; });
+    }
+
+    /**
+     * Constructs the hybrid filter from a sorted range of integers, choosing the encoding of each partition by the
+     * FPR of the two data structures on the sample of queries in [q_begin, q_end) which fall in the partition. The
+     * queries can be any iterable of pairs or tuples whose first two elements are the endpoints of the range.
+     *
+     * @tparam t_itr the type of the iterator of the keys
+     * @tparam q_itr the type of the iterator of the queries
+     * @param begin the beginning of the sorted range of keys
+     * @param end the end of the sorted range of keys
+     * @param bpk the desired number of bits per key of each partition
+     * @param q_begin the begin iterator of the query sample
+     * @param q_end the end iterator of the query sample
+     * @param partition_size the number of keys in each partition
+     */
+    template <class t_itr, class q_itr>
+    hybrid_filter(const t_itr begin, const t_itr end, const double bpk, const q_itr q_begin, const q_itr q_end,
+                  const size_t partition_size = 1 << 16)
+    {
+        /*
+         * The empty queries of the sample are clipped to the partitions they intersect and grouped by partition.
          */
-        if constexpr (is_iterable_v<RangeEmptinessDS>)
+        std::vector<std::vector<std::pair<value_type, value_type>>> sample((std::distance(begin, end) + partition_size - 1) / partition_size);
+        for (auto it = q_begin; it != q_end; ++it)
         {
-            auto v = std::lower_bound(ds.begin(), ds.end(), hash_k);
-            return (v != ds.end()) && (*v == hash_k);
+            value_type left = std::get<0>(*it), right = std::get<1>(*it);
+            auto next = std::lower_bound(begin, end, left);
+            if ((next != end) && (*next <= right))
+                continue;
+            size_t i = (next == begin) ? 0 : (std::distance(begin, next) - 1) / partition_size;
+            for (; i < sample.size(); ++i)
+            {
+                const value_type lo = (i == 0) ? 0 : *(begin + i * partition_size);
+                const value_type hi = (i + 1 < sample.size()) ? *(begin + (i + 1) * partition_size) - 1 : std::numeric_limits<value_type>::max();
+                if (lo > right)
+                    break;
+                sample[i].emplace_back(std::max(left, lo), std::min(right, hi));
+            }
         }
 
-        return ds.check_presence(hash_k);
+        build(begin, end, bpk, partition_size, [&](auto p_begin, auto p_end, auto base) {
+            return bucket_wins(p_begin, p_end, base, bpk, sample[std::distance(begin, p_begin) / partition_size]); });
     }
 
+    hybrid_filter(hybrid_filter &&hf) noexcept = default;
+
+    hybrid_filter &operator=(hybrid_filter &&hf) noexcept = default;
+
     /**
-     * @brief Returns the size in bytes of the Grafite range filter.
-     * The expected size of the grafite range filter is n * bpk bits. Where bpk can be calculated as
-     * bpk = log2(r/n) + overhead, where r is the size of the reduced universe and overhead is the overhead of the
-     * underlying container data structure (2 with Elias-Fano).
+     * The query function checks if the range [left, right] is present in the hybrid filter, by querying each
+     * partition intersecting the range until one of them answers positively.
      *
-     * @return the size in bytes of the Grafite range filter
+     * @param left the left endpoint of the range
+     * @param right the right endpoint of the range
+     * @return true if the range is possibly present, false if it is definitely not
      */
-    auto size() const
+    bool query(const value_type left, const value_type right) const
     {
-        if constexpr (is_vector<RangeEmptinessDS>())
-            return sizeof(filter) + (ds.size() * sizeof(value_type));
-#ifdef SUCCINCT_LIB_SDSL
-        else if constexpr (std::is_same_v<RangeEmptinessDS, sdsl::int_vector<>>)
-            return sizeof(filter) + sdsl::size_in_bytes(ds);
-#endif
-        return sizeof(filter) + ds.size();
+        if (right < left)
+            throw std::runtime_error("range parameters are not sorted");
+        if (bounds.empty())
+            return false;
+
+        auto i = (size_t) std::distance(bounds.begin(), std::upper_bound(bounds.begin(), bounds.end(), left)) - 1;
+        for (; i < bounds.size() && bounds[i] <= right; ++i)
+        {
+            auto hi = (i + 1 < bounds.size()) ? bounds[i + 1] - 1 : std::numeric_limits<value_type>::max();
+            if (query_partition(i, std::max(left, bounds[i]), std::min(right, hi)))
+                return true;
+        }
+        return false;
     }
 
-    friend std::ostream &operator<<(std::ostream &out, const filter &rf)
+    /**
+     * The query function checks if the element [x] is present in the hybrid filter.
+     *
+     * @param x the point
+     * @return true if the element is possibly present, false if it is definitely not
+     */
+    bool query(const value_type x) const
     {
-        out.write(reinterpret_cast<const char *>(&rf.first), sizeof(rf.first));
-        out.write(reinterpret_cast<const char *>(&rf.last), sizeof(rf.last));
-        out.write(reinterpret_cast<const char *>(&rf.n_items), sizeof(rf.n_items));
-        out.write(reinterpret_cast<const char *>(&rf.a), sizeof(rf.a));
-        out.write(reinterpret_cast<const char *>(&rf.b), sizeof(rf.b));
-        out.write(reinterpret_cast<const char *>(&rf.r), sizeof(rf.r));
-        out << rf.ds;
-        return out;
+        return query(x, x);
     }
 
-    friend std::istream &operator>>(std::istream &in, filter &rf)
+    /**
+     * Returns the number of partitions encoded with a grafite::bucket and with a grafite::filter, respectively.
+     */
+    [[nodiscard]] std::pair<size_t, size_t> partitions() const
     {
-        in.read(reinterpret_cast<char *>(&rf.first), sizeof(rf.first));
-        in.read(reinterpret_cast<char *>(&rf.last), sizeof(rf.last));
-        in.read(reinterpret_cast<char *>(&rf.n_items), sizeof(rf.n_items));
-        in.read(reinterpret_cast<char *>(&rf.a), sizeof(rf.a));
-        in.read(reinterpret_cast<char *>(&rf.b), sizeof(rf.b));
-        in.read(reinterpret_cast<char *>(&rf.r), sizeof(rf.r));
-        in >> rf.ds;
-        return in;
+        return {buckets.size(), filters.size()};
     }
 
-};
+    /**
+     * The size function returns the size of the hybrid filter in bytes, including the directory.
+     *
+     * @return the size of the hybrid filter in bytes
+     */
+    auto size() const
+    {
+        size_t s = sizeof(hybrid_filter) + bounds.size() * (sizeof(value_type) + sizeof(uint32_t));
+        for (const auto &f : filters)
+            s += f.size();
+        for (const auto &b : buckets)
+            s += b.size();
+        return s;
+    }
 
-template <class RangeEmptinessContainer, unsigned int default_bpk_overhead>
-std::random_device filter<RangeEmptinessContainer, default_bpk_overhead>::rd;
+    /**
+     * The memory_report function returns the memory used by the hybrid filter, summed over all the partitions. The
+     * directory is accounted as header bytes.
+     */
+    [[nodiscard]] grafite::memory_report memory_report() const
+    {
+        grafite::memory_report m;
+        m.header_bytes = sizeof(hybrid_filter) + bounds.size() * sizeof(value_type) + slots.size() * sizeof(uint32_t);
+        add_vector_slack(m, bounds);
+        add_vector_slack(m, slots);
+        for (const auto &f : filters)
+            m += f.memory_report();
+        for (const auto &b : buckets)
+            m += b.memory_report();
+        add_vector_slack(m, filters);
+        add_vector_slack(m, buckets);
+        return m;
+    }
 
-template <class RangeEmptinessContainer, unsigned int default_bpk_overhead>
-std::mt19937 filter<RangeEmptinessContainer, default_bpk_overhead>::gen(filter<RangeEmptinessContainer, default_bpk_overhead>::rd());
+    friend std::ostream &operator<<(std::ostream &out, const hybrid_filter &hf)
+    {
+        write_vector(out, hf.bounds);
+        write_vector(out, hf.slots);
+        const uint64_t n_filters = hf.filters.size(), n_buckets = hf.buckets.size();
+        out.write(reinterpret_cast<const char *>(&n_filters), sizeof(n_filters));
+        for (const auto &f : hf.filters)
+            out << f;
+        out.write(reinterpret_cast<const char *>(&n_buckets), sizeof(n_buckets));
+        for (const auto &b : hf.buckets)
+            out << b;
+        return out;
+    }
 
-template <class RangeEmptinessContainer, unsigned int default_bpk_overhead>
-std::uniform_int_distribution<typename filter<RangeEmptinessContainer, default_bpk_overhead>::value_type>
-        filter<RangeEmptinessContainer, default_bpk_overhead>::distr(1, std::numeric_limits<typename filter<RangeEmptinessContainer, default_bpk_overhead>::value_type>::max());
+    friend std::istream &operator>>(std::istream &in, hybrid_filter &hf)
+    {
+        read_vector(in, hf.bounds);
+        read_vector(in, hf.slots);
+        uint64_t n_filters = 0, n_buckets = 0;
+        in.read(reinterpret_cast<char *>(&n_filters), sizeof(n_filters));
+        hf.filters.clear();
+        hf.filters.resize(in ? n_filters : 0);
+        for (auto &f : hf.filters)
+            in >> f;
+        in.read(reinterpret_cast<char *>(&n_buckets), sizeof(n_buckets));
+        hf.buckets.clear();
+        hf.buckets.resize(in ? n_buckets : 0);
+        for (auto &b : hf.buckets)
+            in >> b;
+        return in;
+    }
+};
 
 } // namespace grafite
\ No newline at end of file
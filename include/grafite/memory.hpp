@@ -0,0 +1,100 @@
+/*
+ * This file is part of Grafite <https://github.com/marcocosta97/grafite>.
+ * Copyright (C) 2023 Marco Costa.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+namespace grafite {
+
+/**
+ * The memory_report struct breaks down the memory used by a data structure, as returned by the 'memory_report()'
+ * method of the containers and of the filters. The sum of the first five fields is close to the 'size()' of the data
+ * structure, while 'total()' also includes the memory lost to the heap allocator and to the unused capacity.
+ *
+ * Not all the fields are measured. The slack is always an estimate, as the overhead of the allocator is modeled (see
+ * grafite::heap_overhead). The reclaimable bytes are only the spare capacity of the std::vector containers. The
+ * Elias-Fano containers are allocated at their exact size, so they report 0 reclaimable bytes. When a container does
+ * not expose its components, e.g. grafite::ef_sux_vector, the split between upper bits, lower bits and index is
+ * derived from a model of the library and 'estimated_breakdown' is set. Only the total of the split equals the
+ * measured 'size()'.
+ */
+struct memory_report
+{
+    size_t header_bytes = 0; /* the objects themselves and their directories (e.g. the segments of the buckets) */
+    size_t upper_bits_bytes = 0; /* the upper bits of the Elias-Fano containers */
+    size_t lower_bits_bytes = 0; /* the lower bits of the Elias-Fano containers */
+    size_t index_bytes = 0; /* the select and rank indexes of the Elias-Fano containers */
+    size_t data_bytes = 0; /* the content of the containers other than Elias-Fano (e.g. plain vectors) */
+    size_t slack_bytes = 0; /* the (estimated) overhead of the heap allocator plus the unused capacity */
+    size_t reclaimable_bytes = 0; /* the part of 'slack_bytes' that can be released, e.g. by rebuilding or shrinking */
+    bool estimated_breakdown = false; /* true if the split of some container into its components is modeled */
+
+    [[nodiscard]] size_t total() const
+    {
+        return header_bytes + upper_bits_bytes + lower_bits_bytes + index_bytes + data_bytes + slack_bytes;
+    }
+
+    memory_report &operator+=(const memory_report &m)
+    {
+        header_bytes += m.header_bytes;
+        upper_bits_bytes += m.upper_bits_bytes;
+        lower_bits_bytes += m.lower_bits_bytes;
+        index_bytes += m.index_bytes;
+        data_bytes += m.data_bytes;
+        slack_bytes += m.slack_bytes;
+        reclaimable_bytes += m.reclaimable_bytes;
+        estimated_breakdown |= m.estimated_breakdown;
+        return *this;
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const memory_report &m)
+    {
+        out << "header=" << m.header_bytes << ", upper_bits=" << m.upper_bits_bytes
+            << ", lower_bits=" << m.lower_bits_bytes << ", index=" << m.index_bytes << ", data=" << m.data_bytes
+            << ", slack=" << m.slack_bytes << ", reclaimable=" << m.reclaimable_bytes << ", total=" << m.total();
+        if (m.estimated_breakdown)
+            out << " (estimated breakdown)";
+        return out;
+    }
+};
+
+/**
+ * Returns the bytes wasted by the heap allocator for a block of 'n' bytes. It models the glibc allocator, which
+ * prepends an 8-byte header to each block and rounds the block to a multiple of 16 bytes.
+ */
+constexpr size_t heap_overhead(const size_t n)
+{
+    return n == 0 ? 0 : ((n + 8 + 15) & ~size_t(15)) - n;
+}
+
+/**
+ * Adds to 'm' the unused capacity of the vector 'v' and the overhead of its heap block. The elements are not added,
+ * as their accounting depends on the type (see the callers).
+ */
+template <class T, class A>
+void add_vector_slack(memory_report &m, const std::vector<T, A> &v)
+{
+    const auto unused = (v.capacity() - v.size()) * sizeof(T);
+    m.slack_bytes += unused + heap_overhead(v.capacity() * sizeof(T));
+    m.reclaimable_bytes += unused;
+}
+
+} // namespace grafite
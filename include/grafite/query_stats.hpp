@@ -0,0 +1,224 @@
+/*
+ * This file is part of Grafite <https://github.com/marcocosta97/grafite>.
+ * Copyright (C) 2023 Marco Costa.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * The query-path instrumentation of grafite::filter and grafite::point_filter is enabled by defining the macro
+ * GRAFITE_QUERY_STATS. When it is not defined, the macros below expand to the bare expressions, so that the query
+ * code is the same as without instrumentation.
+ *
+ *  - GRAFITE_QUERY_PATH(path, expr): evaluates the boolean 'expr', the answer of a query leaving through 'path', and
+ *    counts the query and its answer.
+ *  - GRAFITE_TIMED(timer, expr): evaluates 'expr' and adds its latency to 'timer'.
+ */
+#ifdef GRAFITE_QUERY_STATS
+#define GRAFITE_QUERY_PATH(path, expr) grafite::query_stats::record(grafite::query_path::path, (expr))
+#define GRAFITE_TIMED(timer, expr) grafite::query_stats::timed(grafite::query_timer::timer, [&] { return (expr); })
+#else
+#define GRAFITE_QUERY_PATH(path, expr) (expr)
+#define GRAFITE_TIMED(timer, expr) (expr)
+#endif
+
+namespace grafite {
+
+/**
+ * The exits of the query methods of grafite::filter.
+ *  - point_outside: the hash of the point query is outside [first, last].
+ *  - point_probe: the point query reaches the container.
+ *  - range_wrap_around: the hashed range wraps around the reduced universe, i.e. 'hash(left) > hash(right)'.
+ *  - range_outside: the hashed range does not intersect [first, last].
+ *  - range_right_overlap: the hashed range contains 'last'.
+ *  - range_left_overlap: the hashed range contains 'first'.
+ *  - range_probe: the range query reaches the container.
+ */
+enum class query_path
+{
+    point_outside,
+    point_probe,
+    range_wrap_around,
+    range_outside,
+    range_right_overlap,
+    range_left_overlap,
+    range_probe,
+    count
+};
+
+/**
+ * The phases of the query methods whose latency is measured: the hashing of the endpoints and the container probes.
+ */
+enum class query_timer
+{
+    hash,
+    probe,
+    count
+};
+
+constexpr size_t n_query_paths = size_t(query_path::count);
+constexpr size_t n_query_timers = size_t(query_timer::count);
+
+inline const char *to_string(const query_path p)
+{
+    constexpr const char *names[] = {"point_outside", "point_probe", "range_wrap_around", "range_outside",
+                                     "range_right_overlap", "range_left_overlap", "range_probe"};
+    return names[size_t(p)];
+}
+
+inline const char *to_string(const query_timer t)
+{
+    constexpr const char *names[] = {"hash", "probe"};
+    return names[size_t(t)];
+}
+
+/**
+ * A snapshot of the query-path counters, summed over all the threads.
+ */
+struct query_stats_snapshot
+{
+    std::array<uint64_t, n_query_paths> queries{}; /* the number of queries leaving through each path */
+    std::array<uint64_t, n_query_paths> positives{}; /* the number of positive answers of each path */
+    std::array<uint64_t, n_query_timers> calls{}; /* the number of measured calls of each phase */
+    std::array<uint64_t, n_query_timers> nanoseconds{}; /* the total latency of each phase */
+
+    friend std::ostream &operator<<(std::ostream &out, const query_stats_snapshot &s)
+    {
+        for (size_t p = 0; p < n_query_paths; ++p)
+            out << to_string(query_path(p)) << "=" << s.queries[p] << " (" << s.positives[p] << " positives)\n";
+        for (size_t t = 0; t < n_query_timers; ++t)
+            out << to_string(query_timer(t)) << "=" << s.calls[t] << " calls, "
+                << (s.calls[t] ? double(s.nanoseconds[t]) / s.calls[t] : 0) << " ns/call\n";
+        return out;
+    }
+};
+
+/**
+ * The query_stats class collects the counters of the instrumented query methods (see GRAFITE_QUERY_STATS). Each
+ * thread updates its own block of counters, aligned to the cache lines, with relaxed atomic stores, and the blocks
+ * are summed by 'snapshot'. The blocks of the terminated threads are kept, so that their counts are not lost.
+ */
+class query_stats
+{
+private:
+    struct alignas(64) thread_counters
+    {
+        std::array<std::atomic<uint64_t>, n_query_paths> queries{};
+        std::array<std::atomic<uint64_t>, n_query_paths> positives{};
+        std::array<std::atomic<uint64_t>, n_query_timers> calls{};
+        std::array<std::atomic<uint64_t>, n_query_timers> nanoseconds{};
+    };
+
+    struct registry
+    {
+        std::mutex m;
+        std::vector<std::unique_ptr<thread_counters>> blocks;
+    };
+
+    static registry &global()
+    {
+        static registry r;
+        return r;
+    }
+
+    static thread_counters &local()
+    {
+        thread_local thread_counters *c = [] {
+            auto &r = global();
+            std::lock_guard<std::mutex> lock(r.m);
+            r.blocks.emplace_back(std::make_unique<thread_counters>());
+            return r.blocks.back().get();
+        }();
+        return *c;
+    }
+
+    /* only the owner thread writes a counter, thus a relaxed load and store is enough to increment it */
+    static inline void add(std::atomic<uint64_t> &counter, const uint64_t v)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+
+public:
+    static inline bool record(const query_path p, const bool result)
+    {
+        auto &c = local();
+        add(c.queries[size_t(p)], 1);
+        add(c.positives[size_t(p)], result);
+        return result;
+    }
+
+    template <class F>
+    static inline auto timed(const query_timer t, F &&f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        auto res = f();
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        auto &c = local();
+        add(c.calls[size_t(t)], 1);
+        add(c.nanoseconds[size_t(t)], ns.count());
+        return res;
+    }
+
+    /**
+     * Returns the counters summed over all the threads.
+     */
+    static query_stats_snapshot snapshot()
+    {
+        query_stats_snapshot s;
+        auto &r = global();
+        std::lock_guard<std::mutex> lock(r.m);
+        for (const auto &c : r.blocks)
+        {
+            for (size_t p = 0; p < n_query_paths; ++p)
+            {
+                s.queries[p] += c->queries[p].load(std::memory_order_relaxed);
+                s.positives[p] += c->positives[p].load(std::memory_order_relaxed);
+            }
+            for (size_t t = 0; t < n_query_timers; ++t)
+            {
+                s.calls[t] += c->calls[t].load(std::memory_order_relaxed);
+                s.nanoseconds[t] += c->nanoseconds[t].load(std::memory_order_relaxed);
+            }
+        }
+        return s;
+    }
+
+    /**
+     * Resets the counters of all the threads. It must not be called concurrently with the queries.
+     */
+    static void reset()
+    {
+        auto &r = global();
+        std::lock_guard<std::mutex> lock(r.m);
+        for (auto &c : r.blocks)
+        {
+            for (size_t p = 0; p < n_query_paths; ++p)
+                c->queries[p] = 0, c->positives[p] = 0;
+            for (size_t t = 0; t < n_query_timers; ++t)
+                c->calls[t] = 0, c->nanoseconds[t] = 0;
+        }
+    }
+};
+
+} // namespace grafite
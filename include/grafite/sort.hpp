@@ -0,0 +1,272 @@
+/*
+ * This file is part of Grafite <https://github.com/marcocosta97/grafite>.
+ * Copyright (C) 2023 Marco Costa.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "build_executor.hpp"
+
+#if defined(USE_LIBRARY_BOOST_PARALLEL) || defined(USE_LIBRARY_BOOST)
+#include <boost/sort/sort.hpp>
+#define MAX_THREADS 12
+#elif defined(USE_LIBRARY_STL_PARALLEL)
+#include <execution>
+#endif
+
+namespace grafite {
+
+/**
+ * The algorithms used to sort the hashed keys during the construction of the filters.
+ *  - automatic: picks one of the following by the number of keys and the thread budget (see grafite::select_sort_backend).
+ *  - std_sort: std::sort, the cheapest for small inputs.
+ *  - spreadsort: the Boost hybrid radix sort if Boost is enabled, the built-in radix sort otherwise.
+ *  - parallel_block: the Boost parallel block sort if USE_LIBRARY_BOOST_PARALLEL is defined, std::sort with the
+ *    parallel execution policy if USE_LIBRARY_STL_PARALLEL is defined, grafite::parallel_sort otherwise. If a build
+ *    executor is set, grafite::parallel_sort runs on it in any case.
+ *  - radix: the built-in LSD radix sort (see grafite::radix_sort).
+ */
+enum class sort_backend
+{
+    automatic,
+    std_sort,
+    spreadsort,
+    parallel_block,
+    radix
+};
+
+/**
+ * Parses the name of a sort backend, as printed by grafite::to_string.
+ */
+inline sort_backend sort_backend_from_string(const std::string &name)
+{
+    if (name == "auto") return sort_backend::automatic;
+    if (name == "std") return sort_backend::std_sort;
+    if (name == "spreadsort") return sort_backend::spreadsort;
+    if (name == "parallel") return sort_backend::parallel_block;
+    if (name == "radix") return sort_backend::radix;
+    throw std::runtime_error("error, sort backend unknown.");
+}
+
+inline std::string to_string(const sort_backend backend)
+{
+    switch (backend)
+    {
+        case sort_backend::std_sort: return "std";
+        case sort_backend::spreadsort: return "spreadsort";
+        case sort_backend::parallel_block: return "parallel";
+        case sort_backend::radix: return "radix";
+        default: return "auto";
+    }
+}
+
+/**
+ * The phases of the construction of a grafite::filter, in order: the scan for the maximum key, the hashing of the
+ * keys, the sorting of the hashes and the encoding of the container. Note that the scan is a separate pass over the
+ * keys only when the phases are reported (see build_options::on_phase_end), otherwise it is fused with the hashing.
+ */
+enum class build_phase
+{
+    max_key_scan,
+    hashing,
+    sort,
+    encoding
+};
+
+inline std::string to_string(const build_phase phase)
+{
+    switch (phase)
+    {
+        case build_phase::max_key_scan: return "max_key_scan";
+        case build_phase::hashing: return "hashing";
+        case build_phase::sort: return "sort";
+        default: return "encoding";
+    }
+}
+
+/**
+ * The options of the construction of the filters.
+ */
+struct build_options
+{
+    sort_backend sort = sort_backend::automatic; /* the sort algorithm, see grafite::sort_backend */
+    size_t max_threads = 0; /* the thread budget of the construction, 0 to use the default (see grafite::thread_budget) */
+    std::function<void(build_phase)> on_phase_end; /* if set, called at the end of each phase of the construction */
+};
+
+/**
+ * Returns the number of threads the construction may use: 'options.max_threads' if set, otherwise the concurrency of
+ * the global build executor if any, otherwise the number of hardware threads (capped to MAX_THREADS, or 8) if a
+ * parallel library is enabled at compile time, otherwise 1.
+ */
+inline size_t thread_budget(const build_options &options = {})
+{
+    if (options.max_threads > 0)
+        return options.max_threads;
+    if (auto *executor = build_executor::global().load())
+        return executor->concurrency();
+#if defined(USE_LIBRARY_BOOST_PARALLEL) || defined(USE_LIBRARY_STL_PARALLEL)
+#ifdef MAX_THREADS
+    return std::max(1U, std::min(std::thread::hardware_concurrency(), (unsigned int) MAX_THREADS));
+#else
+    return std::max(1U, std::min(std::thread::hardware_concurrency(), (unsigned int) 8));
+#endif
+#else
+    return 1;
+#endif
+}
+
+/**
+ * Picks the sort algorithm for 'n' keys and a budget of 'n_threads' threads. Small inputs are sorted with std::sort,
+ * large inputs with the parallel block sort if more than one thread is available, and the rest with the radix sort
+ * (spreadsort if Boost is enabled), whose running time is linear in the number of keys.
+ */
+inline sort_backend select_sort_backend(const size_t n, const size_t n_threads)
+{
+    constexpr size_t max_std_sort_size = 1 << 12;
+    constexpr size_t min_parallel_size = 1 << 20;
+
+    if (n <= max_std_sort_size)
+        return sort_backend::std_sort;
+    if (n_threads > 1 && n >= min_parallel_size)
+        return sort_backend::parallel_block;
+#if defined(USE_LIBRARY_BOOST_PARALLEL) || defined(USE_LIBRARY_BOOST)
+    return sort_backend::spreadsort;
+#else
+    return sort_backend::radix;
+#endif
+}
+
+/**
+ * Sorts the vector 'v', whose elements are non-negative integers at most 'max_value', with an LSD radix sort on
+ * digits of 8 bits. The number of passes is given by the bit width of 'max_value', and the passes on digits that are
+ * equal in all the elements are skipped.
+ */
+template <class T>
+void radix_sort(std::vector<T> &v, const T max_value)
+{
+    static_assert(std::is_integral_v<T>, "radix_sort requires an integral type");
+    constexpr size_t digit_bits = 8;
+    constexpr size_t n_digit_values = size_t(1) << digit_bits;
+    using unsigned_type = std::make_unsigned_t<T>;
+
+    size_t n_passes = 0;
+    for (auto m = (unsigned_type) max_value; m > 0; m >>= digit_bits)
+        ++n_passes;
+    const auto n = v.size();
+    if (n < 2 || n_passes == 0)
+        return;
+
+    auto digit = [](const T x, const size_t pass) { return ((unsigned_type) x >> (pass * digit_bits)) & (n_digit_values - 1); };
+    std::vector<std::array<size_t, n_digit_values>> counts(n_passes);
+    for (auto &c : counts)
+        c.fill(0);
+    for (const auto x : v)
+        for (size_t p = 0; p < n_passes; ++p)
+            counts[p][digit(x, p)]++;
+
+    std::vector<T> buffer(n);
+    for (size_t p = 0; p < n_passes; ++p)
+    {
+        auto &c = counts[p];
+        if (c[digit(v[0], p)] == n)
+            continue;
+        size_t sum = 0;
+        for (auto &count : c)
+            sum += std::exchange(count, sum);
+        for (const auto x : v)
+            buffer[c[digit(x, p)]++] = x;
+        v.swap(buffer);
+    }
+}
+
+/**
+ * Returns the pool of 'n_threads' threads used by the parallel block sort when no build executor is set. The pool is
+ * created by the first sort with this thread budget and reused by the following ones, so that each sort does not
+ * spawn and join its own threads.
+ */
+inline work_stealing_executor &shared_sort_executor(const size_t n_threads)
+{
+    static std::mutex m;
+    static std::map<size_t, std::unique_ptr<work_stealing_executor>> pools;
+    std::lock_guard<std::mutex> lock(m);
+    auto &pool = pools[n_threads];
+    if (!pool)
+        pool = std::make_unique<work_stealing_executor>(n_threads);
+    return *pool;
+}
+
+/**
+ * Sorts the vector 'v', whose elements are non-negative integers at most 'max_value', with the algorithm given by
+ * 'options' (see grafite::sort_backend).
+ */
+template <class T>
+void sort_keys(std::vector<T> &v, const T max_value, const build_options &options = {})
+{
+    const auto n_threads = thread_budget(options);
+    auto backend = options.sort;
+    if (backend == sort_backend::automatic)
+        backend = select_sort_backend(v.size(), n_threads);
+
+    switch (backend)
+    {
+        case sort_backend::spreadsort:
+#if defined(USE_LIBRARY_BOOST_PARALLEL) || defined(USE_LIBRARY_BOOST)
+            /*
+             * The spreadsort function is faster than std::sort and exploits the fact that the size of the maximum
+             * hash is bounded via hybrid radix sort.
+             */
+            boost::sort::spreadsort::spreadsort(v.begin(), v.end());
+            break;
+#else
+            [[fallthrough]];
+#endif
+        case sort_backend::radix:
+            radix_sort(v, max_value);
+            break;
+        case sort_backend::parallel_block:
+            if (auto *executor = build_executor::global().load())
+                parallel_sort(*executor, v, max_value);
+            else
+            {
+#if defined(USE_LIBRARY_BOOST_PARALLEL)
+                boost::sort::block_indirect_sort(v.begin(), v.end(), n_threads);
+#elif defined(USE_LIBRARY_STL_PARALLEL)
+                std::sort(std::execution::par, v.begin(), v.end());
+#else
+                parallel_sort(shared_sort_executor(n_threads), v, max_value);
+#endif
+            }
+            break;
+        default:
+            std::sort(v.begin(), v.end());
+    }
+}
+
+} // namespace grafite
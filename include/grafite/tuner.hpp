@@ -0,0 +1,386 @@
+/*
+ * This file is part of Grafite <https://github.com/marcocosta97/grafite>.
+ * Copyright (C) 2023 Marco Costa.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <tuple>
+#include "grafite.hpp"
+
+namespace grafite {
+
+/**
+ * The kind of range filter recommended by the grafite::tuner class.
+ */
+enum class filter_kind { grafite, bucket };
+
+/**
+ * The output of the grafite::tuner class. The parameters 'eps' and 'L' can be passed directly to the constructor
+ * 'filter(begin, end, eps, L)', while 'bpk' can be passed to both 'filter(begin, end, bpk)' and
+ * 'bucket(begin, end, bpk)' depending on the recommended 'kind'. The sizes of the candidates are estimated on a
+ * subsample of the keys and rescaled to the whole input, and the ones of the recommended data structure are measured
+ * if 'confirmed' is set. If the grafite::filter cannot be built within the budget, its size is infinite and its FPR 1.
+ */
+struct tuning_result
+{
+    filter_kind kind;
+    double bpk; /* the bits per key to pass to the constructor of the recommended data structure */
+    double eps; /* the false positive rate guaranteed by the grafite::filter for ranges of size at most 'L' */
+    uint64_t L;
+    double filter_fpr; /* the FPR of the grafite::filter on the query sample */
+    double bucket_fpr; /* the FPR of the grafite::bucket on the query sample */
+    double filter_bpk; /* the size in bits per key of the grafite::filter */
+    double bucket_bpk; /* the size in bits per key of the grafite::bucket */
+    size_t trial_builds; /* the number of data structures built over the subsample of the keys */
+    bool confirmed; /* true if the size and the FPR of the recommended data structure are measured over all the keys */
+
+    [[nodiscard]] double expected_fpr() const
+    {
+        return (kind == filter_kind::grafite) ? filter_fpr : bucket_fpr;
+    }
+};
+
+/**
+ * The grafite::tuner class picks the parameters of a range filter given the input keys, a sample of the query
+ * workload and a memory budget. The tuner recommends either a grafite::filter or a grafite::bucket, the one with
+ * the lowest false positive rate on the (empty) queries of the sample.
+ *
+ * The candidates are evaluated on a subsample of at most 'max_sample_keys' keys, taken at a fixed stride 'k':
+ *  - the grafite::filter built over the subsample with a given bpk has the same FPR as the one built over all the
+ *    keys, since its reduced universe scales with the number of keys, and its size per key is rescaled to the input.
+ *    If it exceeds the budget, the next trial build lowers the bpk by the excess.
+ *  - the grafite::bucket is modeled by the Elias-Fano encoding of its non-empty buckets, whose number is estimated from
+ *    the pairs of consecutive keys at the positions 'k, 2k, ...' that fall into different buckets. The largest bpk
+ *    whose modeled size fits the budget is found by bisection, and a trial build over the subsample (with the same
+ *    bucket size) calibrates the model against the actual overhead of the container. Its FPR on the query sample is
+ *    computed exactly, by checking the keys covered by the buckets of each query.
+ * The recommended data structure is then built once over all the keys to measure its size and FPR, unless
+ * 'confirm_build' is false. Thus, the tuner runs in time O(b (m + q log m) + n + q log n), where 'b' is the number of
+ * trial builds, 'm' the size of the subsample and 'q' the size of the query sample. If the input has at most
+ * 'max_sample_keys' keys, the trial builds are over the whole input and their measures are exact.
+ *
+ * Note that the FPR of the grafite::bucket is only as representative as the query sample given to the tuner, while
+ * the guarantee of the grafite::filter holds for any workload.
+ *
+ * @tparam RangeEmptinessDS the container data structure of the grafite::filter
+ * @tparam EliasFanoDS the container data structure of the grafite::bucket
+ */
+#if defined(SUCCINCT_LIB_SUX)
+template <class RangeEmptinessDS = ef_sux_vector, class EliasFanoDS = ef_sux_vector>
+#elif defined(SUCCINCT_LIB_SDSL)
+template <class RangeEmptinessDS = ef_sdsl_vector, class EliasFanoDS = ef_sdsl_vector>
+#else
+template <class RangeEmptinessDS, class EliasFanoDS>
+#endif
+class tuner
+{
+private:
+    using value_type = uint64_t;
+    using filter_type = filter<RangeEmptinessDS>;
+    using bucket_type = bucket<EliasFanoDS>;
+
+    constexpr static double ef_overhead = 2.0; /* the bpk overhead of Elias-Fano w.r.t. log2(u/n) */
+    constexpr static double bpk_step = 0.01; /* the resolution of the bpk searched by the tuner */
+
+    std::vector<std::pair<value_type, value_type>> empty_queries; /* the empty queries of the sample */
+    std::vector<value_type> all_lengths; /* the lengths of all the queries of the sample, sorted */
+    const value_type *keys_ptr = nullptr;
+    value_type n = 0, u = 0;
+
+    /**
+     * Returns true if there exists a key 'x' in the input set such that 'left <= x <= right'.
+     */
+    [[nodiscard]] bool contains(const value_type left, const value_type right) const
+    {
+        auto it = std::lower_bound(keys_ptr, keys_ptr + n, left);
+        return (it != keys_ptr + n) && (*it <= right);
+    }
+
+    /**
+     * Returns the false positive rate of the range filter 'f' on the empty queries of the sample.
+     */
+    template <class RangeFilter>
+    [[nodiscard]] double sample_fpr(const RangeFilter &f) const
+    {
+        if (empty_queries.empty())
+            return 0;
+        uint64_t fp = 0;
+        for (auto [left, right] : empty_queries)
+            fp += f.query(left, right);
+        return (double) fp / empty_queries.size();
+    }
+
+    /**
+     * Returns the false positive rate on the empty queries of the sample of a grafite::bucket with buckets of size
+     * 's' built over all the keys, i.e. the fraction of the queries whose first and last buckets enclose a key.
+     */
+    [[nodiscard]] double bucket_fpr(const value_type s) const
+    {
+        if (empty_queries.empty())
+            return 0;
+        uint64_t fp = 0;
+        for (auto [left, right] : empty_queries)
+        {
+            const auto hi = (right / s) * s;
+            fp += contains((left / s) * s, hi > std::numeric_limits<value_type>::max() - (s - 1) ? std::numeric_limits<value_type>::max() : hi + s - 1);
+        }
+        return (double) fp / empty_queries.size();
+    }
+
+    /**
+     * Returns the size in bits of the Elias-Fano encoding of 'm' buckets out of the 'U = ceil(u/s)' buckets of size
+     * 's', i.e. 'm * l' lower bits plus 'm + U/2^l' upper bits, with 'l = floor(log2(U/m))'.
+     */
+    [[nodiscard]] double ef_bits(const double m, const value_type s) const
+    {
+        const auto n_buckets = (double) ((u - 1) / s + 1);
+        const auto l = n_buckets > m ? std::floor(std::log2(n_buckets / m)) : 0.0;
+        return m * l + m + n_buckets / std::exp2(l);
+    }
+
+    /**
+     * Returns the estimated number of non-empty buckets of size 's', i.e. one plus the number of consecutive keys
+     * falling into different buckets, extrapolated from the pairs of keys at the positions 'k, 2k, ...'.
+     */
+    [[nodiscard]] double non_empty_buckets(const value_type s, const size_t k) const
+    {
+        if (n < 2)
+            return n;
+        size_t changes = 0, pairs = 0;
+        for (size_t i = std::min<size_t>(k, n - 1); i < n; i += k, ++pairs)
+            changes += (keys_ptr[i - 1] / s) != (keys_ptr[i] / s);
+        return 1 + (double) (n - 1) * changes / pairs;
+    }
+
+    /**
+     * Returns the bucket size of a grafite::bucket built over all the keys with 'bpk' bits per key.
+     */
+    [[nodiscard]] value_type bucket_size(const double bpk) const
+    {
+        return std::max<value_type>(1, std::ceil((double) u / (n * std::exp2(bpk - 2))));
+    }
+
+public:
+    /**
+     * Quantile of the query lengths of the sample used as the parameter 'L' of the grafite::filter.
+     */
+    double L_quantile = 1.0;
+
+    /**
+     * The grafite::bucket is recommended if its FPR is at most (1 + bucket_tolerance) times the one of the
+     * grafite::filter, since its query time is lower.
+     */
+    double bucket_tolerance = 0.0;
+
+    /**
+     * The maximum number of trial builds over the subsample of each candidate data structure.
+     */
+    size_t max_trial_builds = 4;
+
+    /**
+     * The maximum number of keys of the subsample over which the candidates are built.
+     */
+    size_t max_sample_keys = 1 << 20;
+
+    /**
+     * If true, the recommended data structure is built once over all the keys to measure its size and its FPR.
+     */
+    bool confirm_build = true;
+
+    /**
+     * Constructs the tuner from the sorted input keys and a sample of the query workload. The queries can be any
+     * iterable of pairs or tuples whose first two elements are the (inclusive) endpoints of the range, such as the
+     * grafite benchmarks' Workload type. The keys must remain alive for the lifetime of the tuner.
+     *
+     * @tparam t_itr the type of the iterator of the keys
+     * @tparam q_itr the type of the iterator of the queries
+     * @param begin the begin iterator of the sorted keys
+     * @param end the end iterator of the sorted keys
+     * @param q_begin the begin iterator of the query sample
+     * @param q_end the end iterator of the query sample
+     * @param max_queries the maximum number of queries of the sample that are evaluated
+     */
+    template <class t_itr, class q_itr>
+    tuner(const t_itr begin, const t_itr end, const q_itr q_begin, const q_itr q_end,
+          const size_t max_queries = 100'000)
+            : n(std::distance(begin, end))
+    {
+        static_assert(std::is_same_v<typename std::iterator_traits<t_itr>::value_type, value_type>,
+                      "error, the tuner requires a contiguous range of uint64_t keys");
+        if (begin == end)
+            throw std::runtime_error("error, the input is empty");
+        keys_ptr = &*begin;
+        if (!std::is_sorted(begin, end))
+            throw std::runtime_error("error, the input is not sorted");
+        if (*(end - 1) > std::numeric_limits<value_type>::max() - 1)
+            throw std::overflow_error("error, the universe overflows");
+        u = *(end - 1) + 1;
+
+        const auto n_queries = (size_t) std::distance(q_begin, q_end);
+        const auto stride_queries = std::max<size_t>(1, n_queries / std::max<size_t>(1, max_queries));
+        all_lengths.reserve(n_queries / stride_queries + 1);
+        for (size_t i = 0; i < n_queries; i += stride_queries)
+        {
+            const auto &q = *(q_begin + i);
+            value_type left = std::get<0>(q), right = std::get<1>(q);
+            if (right < left)
+                throw std::runtime_error("range parameters are not sorted");
+            all_lengths.push_back(right - left + 1);
+            if (!contains(left, right))
+                empty_queries.emplace_back(left, right);
+        }
+        std::sort(all_lengths.begin(), all_lengths.end());
+    }
+
+    /**
+     * Picks the best range filter and its parameters for the given memory budget. The grafite::filter is not a
+     * candidate if the budget, or the lossless encoding of the keys, leaves it no more than the 2 bits per key of the
+     * Elias-Fano overhead.
+     *
+     * @param budget the memory budget in bytes for the whole filter
+     * @return the recommended data structure and its parameters
+     */
+    [[nodiscard]] tuning_result tune(const uint64_t budget) const
+    {
+        if (budget <= std::max(sizeof(filter_type), sizeof(bucket_type)))
+            throw std::runtime_error("error, the memory budget is smaller than the filter header");
+
+        tuning_result res{};
+        res.filter_bpk = std::numeric_limits<double>::infinity();
+        res.filter_fpr = 1;
+
+        /* the subsample keeps the last key, so that its universe is the one of the input */
+        const size_t k = (n + std::max<size_t>(1, max_sample_keys) - 1) / std::max<size_t>(1, max_sample_keys);
+        std::vector<value_type> sample_keys;
+        if (k > 1)
+        {
+            sample_keys.reserve(n / k + 2);
+            for (size_t i = 0; i < n; i += k)
+                sample_keys.push_back(keys_ptr[i]);
+            if (sample_keys.back() != keys_ptr[n - 1])
+                sample_keys.push_back(keys_ptr[n - 1]);
+        }
+        const auto *s_begin = (k > 1) ? sample_keys.data() : keys_ptr;
+        const auto *s_end = (k > 1) ? sample_keys.data() + sample_keys.size() : keys_ptr + n;
+        const auto m = (size_t) (s_end - s_begin);
+        auto rescale = [&](const uint64_t sample_size, const size_t header) {
+            return (k > 1) ? header + (double) (sample_size - header) * n / m : (double) sample_size;
+        };
+
+        /*
+         * The grafite::filter may exceed its nominal bpk due to the overhead of the container data structure, which is
+         * measured on each trial build and subtracted from the nominal bpk of the next one.
+         */
+        const auto max_bpk = std::log2((double) (u - 1) / n) + ef_overhead; /* the lossless encoding of the keys */
+        const auto budget_bpk = (double) (budget - sizeof(filter_type)) * 8 / n;
+        auto bpk = std::min(budget_bpk, max_bpk - bpk_step);
+        const auto filter_feasible = bpk > ef_overhead;
+        double filter_bytes = std::numeric_limits<double>::infinity();
+        if (filter_feasible)
+        {
+            for (size_t i = 0;; ++i)
+            {
+                filter_type f(s_begin, s_end, bpk);
+                ++res.trial_builds;
+                filter_bytes = rescale(f.size(), sizeof(filter_type));
+                if (filter_bytes <= budget || i + 1 >= max_trial_builds || bpk <= ef_overhead + bpk_step)
+                {
+                    res.filter_fpr = sample_fpr(f);
+                    break;
+                }
+                const auto excess = (filter_bytes - budget) * 8 / n;
+                bpk = std::max(ef_overhead + bpk_step, bpk - excess - bpk_step);
+            }
+            res.filter_bpk = filter_bytes * 8 / n;
+        }
+
+        res.L = 1;
+        if (!all_lengths.empty())
+        {
+            auto pos = (size_t) std::max(1.0, std::ceil(L_quantile * all_lengths.size()));
+            res.L = all_lengths[std::min(pos, all_lengths.size()) - 1];
+        }
+        res.eps = filter_feasible ? res.L / std::exp2(bpk - ef_overhead) : 1.0;
+
+        /*
+         * The grafite::bucket occupies less than its nominal bpk when the keys are clustered, since many of them fall
+         * into the same bucket, and more when the keys are spread, due to the overhead of Elias-Fano. Thus, its bpk is
+         * the largest one whose modeled size fits the budget, searched over the whole range [0, 64]. The model is
+         * scaled by the ratio between the size of the trial build over the subsample and its modeled size.
+         */
+        double scale = 1, bucket_nominal_bpk = 0, bucket_bytes = 0;
+        for (size_t i = 0; i < std::max<size_t>(1, max_trial_builds); ++i)
+        {
+            auto modeled = [&](double b) {
+                return sizeof(bucket_type) + scale * ef_bits(non_empty_buckets(bucket_size(b), k), bucket_size(b)) / 8; };
+            double lo = 0, hi = 64;
+            while (hi - lo > bpk_step)
+            {
+                auto mid = (lo + hi) / 2;
+                if (modeled(mid) <= budget)
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+            bucket_nominal_bpk = lo;
+
+            /* the bucket over the subsample, with 'm' rather than 'n' keys, has the same bucket size */
+            const auto s = bucket_size(lo);
+            bucket_type b(s_begin, s_end, lo + std::log2((double) n / m));
+            ++res.trial_builds;
+            size_t sample_buckets = 1;
+            for (auto it = s_begin + 1; it < s_end; ++it)
+                sample_buckets += (*(it - 1) / s) != (*it / s);
+            const auto sample_bits = ef_bits(sample_buckets, s);
+            const auto new_scale = sample_bits > 0 ? (double) (b.size() - sizeof(bucket_type)) * 8 / sample_bits : 1.0;
+            bucket_bytes = (k > 1) ? sizeof(bucket_type) + new_scale * ef_bits(non_empty_buckets(s, k), s) / 8 : b.size();
+            if (bucket_bytes <= budget || new_scale <= scale)
+                break;
+            scale = new_scale;
+        }
+        res.bucket_bpk = bucket_bytes * 8 / n;
+        res.bucket_fpr = bucket_fpr(bucket_size(bucket_nominal_bpk));
+
+        /*
+         * A candidate that does not fit the budget is recommended only if the other one does not fit either.
+         */
+        const auto filter_fits = filter_feasible && filter_bytes <= budget, bucket_fits = bucket_bytes <= budget;
+        if (!filter_feasible || (bucket_fits && (!filter_fits || res.bucket_fpr <= res.filter_fpr * (1 + bucket_tolerance))))
+            res.kind = filter_kind::bucket, res.bpk = bucket_nominal_bpk;
+        else if (!bucket_fits && !filter_fits && bucket_bytes < filter_bytes)
+            res.kind = filter_kind::bucket, res.bpk = bucket_nominal_bpk;
+        else
+            res.kind = filter_kind::grafite, res.bpk = bpk;
+
+        res.confirmed = (k == 1);
+        if (k > 1 && confirm_build)
+        {
+            if (res.kind == filter_kind::grafite)
+            {
+                filter_type f(keys_ptr, keys_ptr + n, res.bpk);
+                res.filter_bpk = (double) f.size() * 8 / n;
+                res.filter_fpr = sample_fpr(f);
+            }
+            else
+                res.bucket_bpk = (double) bucket_type(keys_ptr, keys_ptr + n, res.bpk).size() * 8 / n;
+            res.confirmed = true;
+        }
+        return res;
+    }
+};
+
+} // namespace grafite
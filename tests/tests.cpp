@@ -11,3 +11,739 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <thread>
+#include "grafite/grafite.hpp"
+#include "grafite/fpr_monitor.hpp"
+#include "grafite/tuner.hpp"
+
+/**
+ * This file contains the tests of the data structures of the library. Each test checks that the data structure has no
+ * false negatives, also after a serialization round trip, and that it handles the empty and single-key inputs.
+ */
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            failures++; \
+        } \
+    } while (0)
+
+/**
+ * Returns 'n' distinct sorted keys drawn uniformly at random in [0, max_key], the same ones for the same seed.
+ */
+std::vector<uint64_t> random_keys(const size_t n, const uint64_t max_key, const uint64_t seed = 42)
+{
+    std::mt19937_64 gen(seed);
+    std::uniform_int_distribution<uint64_t> distr(0, max_key);
+    std::vector<uint64_t> keys;
+    while (keys.size() < n)
+    {
+        for (auto i = keys.size(); i < n; i++)
+            keys.push_back(distr(gen));
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+    return keys;
+}
+
+/**
+ * Serializes 'ds' and returns the data structure deserialized from it.
+ */
+template <class DS>
+DS round_trip(const DS &ds)
+{
+    std::stringstream ss;
+    ss << ds;
+    DS loaded;
+    ss >> loaded;
+    return loaded;
+}
+
+template <class HashPolicy>
+void test_filter_hash_policy()
+{
+    using filter_type = grafite::filter<grafite::ef_sux_vector, 2, false, HashPolicy>;
+    const auto bpk = 12.0;
+
+    std::vector<uint64_t> empty;
+    filter_type f_empty(empty.begin(), empty.end(), bpk);
+    CHECK(!f_empty.query(0));
+    CHECK(!f_empty.query(10, 1000));
+    CHECK(!round_trip(f_empty).query(10, 1000));
+    CHECK(!filter_type().query(10, 1000));
+
+    std::vector<uint64_t> single = {uint64_t(1) << 40};
+    filter_type f_single(single.begin(), single.end(), bpk);
+    CHECK(f_single.query(single[0]));
+    CHECK(round_trip(f_single).query(single[0]));
+
+    /*
+     * The range queries end at a key and do not cross a block of 'r' consecutive integers, so that they are mapped to
+     * a single range of hashed values.
+     */
+    auto keys = random_keys(100000, uint64_t(1) << 48);
+    filter_type f(keys.begin(), keys.end(), bpk);
+    auto loaded = round_trip(f);
+    const auto r = HashPolicy::universe(std::ceil(keys.size() * std::exp2(bpk - 2)));
+    size_t false_negatives = 0, loaded_false_negatives = 0;
+    for (auto k : keys)
+    {
+        const auto left = std::max((k / r) * r, k - std::min<uint64_t>(k, 32));
+        false_negatives += !f.query(k) + !f.query(left, k);
+        loaded_false_negatives += !loaded.query(k) + !loaded.query(left, k);
+    }
+    CHECK(false_negatives == 0);
+    CHECK(loaded_false_negatives == 0);
+
+    /* the batch hashing of the construction must agree with the single-key method */
+    HashPolicy h;
+    h.init(r);
+    std::vector<uint64_t> hashes(keys.size());
+    h(keys.begin(), keys.end(), hashes.begin(), r);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < keys.size(); i++)
+        mismatches += hashes[i] != h(keys[i], r);
+    CHECK(mismatches == 0);
+    CHECK(round_trip(h)(keys[0], r) == h(keys[0], r));
+}
+
+/**
+ * Returns the number of keys for which the point query or the range query ending at the key are negative.
+ */
+template <class DS>
+size_t count_false_negatives(const DS &ds, const std::vector<uint64_t> &keys, const uint64_t range_size = 32)
+{
+    size_t false_negatives = 0;
+    for (auto k : keys)
+        false_negatives += !ds.query(k) + !ds.query(k - std::min(k, range_size), k);
+    return false_negatives;
+}
+
+void test_adaptive_bucket()
+{
+    using adaptive_type = grafite::adaptive_bucket<grafite::ef_sux_vector>;
+    const auto bpk = 10.0;
+
+    std::vector<uint64_t> empty;
+    std::vector<std::pair<uint64_t, uint64_t>> sample;
+    CHECK(!adaptive_type(empty.begin(), empty.end(), bpk).query(0, 1000));
+    CHECK(!adaptive_type(empty.begin(), empty.end(), bpk, sample.begin(), sample.end()).query(0, 1000));
+    CHECK(!adaptive_type().query(0, 1000));
+    CHECK(!round_trip(adaptive_type()).query(0, 1000));
+
+    std::vector<uint64_t> single = {123456789};
+    adaptive_type b_single(single.begin(), single.end(), bpk, 1);
+    CHECK(count_false_negatives(b_single, single) == 0);
+    CHECK(count_false_negatives(round_trip(b_single), single) == 0);
+
+    /*
+     * The sample concentrates the queries on the first segments, so that the bits per key of most segments are
+     * clamped to 2.
+     */
+    auto keys = random_keys(100000, uint64_t(1) << 40);
+    for (size_t i = 0; i < 10000; i++)
+        sample.emplace_back(keys[i % 1000] + 1, keys[i % 1000] + 16);
+    adaptive_type b(keys.begin(), keys.end(), bpk);
+    adaptive_type b_sampled(keys.begin(), keys.end(), bpk, sample.begin(), sample.end());
+    CHECK(count_false_negatives(b, keys) == 0);
+    CHECK(count_false_negatives(b_sampled, keys) == 0);
+    CHECK(count_false_negatives(round_trip(b), keys) == 0);
+    CHECK(count_false_negatives(round_trip(b_sampled), keys) == 0);
+}
+
+/**
+ * Checks the grafite::bucket with 'pow2_buckets' on the empty, single-key and random inputs, also after a round trip.
+ */
+template <bool pow2_buckets>
+void test_bucket()
+{
+    using bucket_type = grafite::bucket<grafite::ef_sux_vector, pow2_buckets>;
+
+    std::vector<uint64_t> single = {123456789};
+    bucket_type b_single(single.begin(), single.end(), 10.0);
+    CHECK(count_false_negatives(b_single, single) == 0);
+    CHECK(count_false_negatives(round_trip(b_single), single) == 0);
+
+    /* from 16 bits per key on keys in [0, 2^20], the bucket size is below 1 and the shift is clamped to 0 */
+    auto dense = random_keys(100000, uint64_t(1) << 20);
+    auto keys = random_keys(100000, uint64_t(1) << 48);
+    for (auto bpk : {4.0, 10.0, 16.0, 24.0})
+    {
+        for (const auto *k : {&dense, &keys})
+        {
+            bucket_type b(k->begin(), k->end(), bpk);
+            auto loaded = round_trip(b);
+            CHECK(loaded.size() == b.size());
+            for (uint64_t range_size : {uint64_t(0), uint64_t(32), uint64_t(1) << 20})
+            {
+                CHECK(count_false_negatives(b, *k, range_size) == 0);
+                CHECK(count_false_negatives(loaded, *k, range_size) == 0);
+            }
+
+            std::mt19937_64 gen(7);
+            size_t mismatches = 0;
+            for (size_t i = 0; i < 100000; i++)
+            {
+                const auto x = gen() >> 16;
+                mismatches += b.query(x, x + 1000) != loaded.query(x, x + 1000);
+            }
+            CHECK(mismatches == 0);
+        }
+    }
+
+    /* the shift is clamped to 63 when the bucket size exceeds 2^63, so that all the keys fall into two buckets */
+    std::vector<uint64_t> far = {1, uint64_t(1) << 62, std::numeric_limits<uint64_t>::max() - 1};
+    bucket_type b_far(far.begin(), far.end(), 0.0);
+    CHECK(count_false_negatives(b_far, far) == 0);
+    CHECK(count_false_negatives(round_trip(b_far), far) == 0);
+    if constexpr (pow2_buckets)
+        CHECK(b_far.query(uint64_t(1) << 63) && round_trip(b_far).query(uint64_t(1) << 63));
+}
+
+void test_hybrid_filter()
+{
+    using hybrid_type = grafite::hybrid_filter<>;
+    const auto bpk = 12.0;
+    const size_t partition_size = 10000;
+
+    std::vector<uint64_t> empty;
+    std::vector<std::pair<uint64_t, uint64_t>> sample;
+    CHECK(!hybrid_type(empty.begin(), empty.end(), bpk).query(0, 1000));
+    CHECK(!hybrid_type(empty.begin(), empty.end(), bpk, sample.begin(), sample.end()).query(0, 1000));
+    CHECK(!hybrid_type().query(0, 1000));
+    CHECK(!round_trip(hybrid_type()).query(0, 1000));
+
+    std::vector<uint64_t> single = {uint64_t(1) << 40};
+    hybrid_type h_single(single.begin(), single.end(), bpk);
+    CHECK(count_false_negatives(h_single, single, 0) == 0);
+    CHECK(count_false_negatives(round_trip(h_single), single, 0) == 0);
+
+    /*
+     * The first half of the keys is uniform, thus its partitions are encoded with a grafite::bucket, while the second
+     * half is made of dense clusters far apart, whose irregular gaps select the grafite::filter. The range queries of
+     * the filter partitions may cross a block of the reduced universe, thus only the point queries are checked there.
+     */
+    auto keys = random_keys(5 * partition_size, uint64_t(1) << 40);
+    std::vector<uint64_t> clustered;
+    for (uint64_t c = 0; c < 50; c++)
+        for (uint64_t i = 0; i < 1000; i++)
+            clustered.push_back((uint64_t(1) << 41) + (c << 34) + i * 3);
+    std::vector<uint64_t> all(keys);
+    all.insert(all.end(), clustered.begin(), clustered.end());
+
+    hybrid_type h(all.begin(), all.end(), bpk, partition_size);
+    CHECK((h.partitions() == std::pair<size_t, size_t>(5, 5)));
+    auto loaded = round_trip(h);
+    CHECK(loaded.partitions() == h.partitions());
+    CHECK(loaded.size() == h.size());
+    CHECK(count_false_negatives(h, keys) == 0);
+    CHECK(count_false_negatives(loaded, keys) == 0);
+    CHECK(count_false_negatives(h, all, 0) == 0);
+    CHECK(count_false_negatives(loaded, all, 0) == 0);
+
+    /* the loaded filter answers the empty queries as the original one, false positives included */
+    std::mt19937_64 gen(7);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < 100000; i++)
+    {
+        const auto x = gen() >> 22;
+        mismatches += h.query(x, x + 15) != loaded.query(x, x + 15);
+    }
+    CHECK(mismatches == 0);
+
+    for (size_t i = 0; i < 10000; i++)
+        sample.emplace_back(keys[i] + 1, keys[i] + 16);
+    hybrid_type h_sampled(all.begin(), all.end(), bpk, sample.begin(), sample.end(), partition_size);
+    CHECK(count_false_negatives(h_sampled, all, 0) == 0);
+    CHECK(count_false_negatives(round_trip(h_sampled), all, 0) == 0);
+}
+
+void test_multi_bucket()
+{
+    using multi_type = grafite::multi_bucket<>;
+    const auto bpk = 16.0;
+
+    std::vector<uint64_t> empty;
+    CHECK(!multi_type(empty.begin(), empty.end(), bpk).query(0));
+    CHECK(!multi_type(empty.begin(), empty.end(), bpk).query(0, 1000));
+    CHECK(!multi_type().query(0, 1000));
+    CHECK(!round_trip(multi_type()).query(0, 1000));
+
+    std::vector<uint64_t> single = {123456789};
+    multi_type b_single(single.begin(), single.end(), bpk);
+    CHECK(count_false_negatives(b_single, single) == 0);
+    CHECK(count_false_negatives(round_trip(b_single), single) == 0);
+
+    auto keys = random_keys(100000, uint64_t(1) << 48);
+    for (unsigned int n_levels : {1, 2, 3})
+    {
+        multi_type b(keys.begin(), keys.end(), bpk, n_levels);
+        auto loaded = round_trip(b);
+        CHECK(loaded.size() == b.size());
+        for (uint64_t range_size : {uint64_t(0), uint64_t(32), uint64_t(1) << 20, uint64_t(1) << 40})
+        {
+            CHECK(count_false_negatives(b, keys, range_size) == 0);
+            CHECK(count_false_negatives(loaded, keys, range_size) == 0);
+        }
+
+        std::mt19937_64 gen(7);
+        size_t mismatches = 0;
+        for (size_t i = 0; i < 100000; i++)
+        {
+            const auto x = gen() >> 16;
+            mismatches += b.query(x, x + 1000) != loaded.query(x, x + 1000);
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+/**
+ * Checks the grafite::point_filter selected by grafite::filter_for with 'pow2_universe' and 'HashPolicy', which must be
+ * forwarded to it and to its grafite::filter base.
+ */
+template <bool pow2_universe, class HashPolicy>
+void test_point_filter()
+{
+    using filter_type = grafite::filter<grafite::ef_sux_vector, 2, pow2_universe, HashPolicy>;
+    using point_type = grafite::filter_for<grafite::point_query_tag, grafite::ef_sux_vector, 2, pow2_universe, HashPolicy>;
+    static_assert(std::is_same_v<grafite::filter_for<grafite::point_query_tag>, grafite::point_filter<>>);
+    static_assert(std::is_same_v<grafite::filter_for<grafite::range_query_tag>, grafite::filter<>>);
+    static_assert(std::is_same_v<point_type, grafite::point_filter<grafite::ef_sux_vector, 2, pow2_universe, HashPolicy>>);
+    static_assert(std::is_base_of_v<filter_type, point_type>);
+    static_assert(std::is_same_v<grafite::filter_for<grafite::range_query_tag, grafite::ef_sux_vector, 2, pow2_universe,
+                                                     HashPolicy>, filter_type>);
+    const auto bpk = 12.0;
+
+    std::vector<uint64_t> empty;
+    CHECK(!point_type(empty.begin(), empty.end(), bpk).query(0));
+    CHECK(!point_type().query(42));
+    CHECK(!round_trip(point_type()).query(42));
+
+    std::vector<uint64_t> single = {uint64_t(1) << 40};
+    point_type p_single(single.begin(), single.end(), bpk);
+    CHECK(p_single.query(single[0]));
+    CHECK(round_trip(p_single).query(single[0]));
+
+    auto keys = random_keys(100000, uint64_t(1) << 48);
+    point_type p(keys.begin(), keys.end(), bpk);
+    auto loaded = round_trip(p);
+    size_t false_negatives = 0;
+    for (auto k : keys)
+        false_negatives += !p.query(k) + !loaded.query(k);
+    CHECK(false_negatives == 0);
+
+    /* the single probe answers as the two rank operations of grafite::filter, false positives included */
+    const filter_type &as_filter = p;
+    std::mt19937_64 gen(7);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < 100000; i++)
+    {
+        const auto x = gen() >> 16;
+        mismatches += (p.query(x) != as_filter.query(x)) + (loaded.query(x) != as_filter.query(x));
+    }
+    CHECK(mismatches == 0);
+}
+
+void test_static_filter()
+{
+    /* 2^14 hashed values for 1000 keys, i.e. about 6 bits per key with Elias-Fano */
+    using static_type = grafite::static_filter<uint64_t(1) << 14, 9973, 12345>;
+    static_assert(sizeof(static_type) == sizeof(grafite::ef_sux_vector));
+
+    std::vector<uint64_t> empty;
+    CHECK(!static_type(empty.begin(), empty.end()).query(0, 1000));
+    CHECK(!static_type().query(0, 1000));
+
+    std::vector<uint64_t> single = {uint64_t(1) << 40};
+    static_type s_single(single.begin(), single.end());
+    CHECK(count_false_negatives(s_single, single) == 0);
+    CHECK(count_false_negatives(round_trip(s_single), single) == 0);
+
+    /*
+     * The input does not need to be sorted, and the range queries may cross a block of the reduced universe, since
+     * the wrapped ranges of hashed values are checked on both sides.
+     */
+    auto keys = random_keys(1000, uint64_t(1) << 40);
+    std::vector<uint64_t> shuffled(keys);
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937_64(7));
+    static_type s(shuffled.begin(), shuffled.end());
+    auto loaded = round_trip(s);
+    for (uint64_t range_size : {uint64_t(0), uint64_t(32), uint64_t(1) << 13})
+    {
+        CHECK(count_false_negatives(s, keys, range_size) == 0);
+        CHECK(count_false_negatives(loaded, keys, range_size) == 0);
+    }
+
+    std::vector<uint64_t> boundary = {(uint64_t(5) << 14) - 1, uint64_t(5) << 14};
+    static_type s_boundary(boundary.begin(), boundary.end());
+    CHECK(s_boundary.query(boundary[0] - 3, boundary[0]));
+    CHECK(s_boundary.query(boundary[1], boundary[1] + 3));
+    CHECK(s_boundary.query(boundary[0], boundary[1]));
+}
+
+void test_work_stealing_executor()
+{
+    for (size_t n_threads : {1, 2, 4})
+    {
+        grafite::work_stealing_executor executor(n_threads);
+        executor.run(0, [](size_t) {});
+
+        /* every task runs once, and no more than 'n_threads' tasks run at the same time, callers included */
+        std::vector<std::atomic<int>> runs(1000);
+        std::atomic<size_t> running(0), max_running(0);
+        auto task = [&](size_t i) {
+            auto now = ++running;
+            for (auto m = max_running.load(); now > m && !max_running.compare_exchange_weak(m, now);) {}
+            runs[i]++;
+            std::this_thread::sleep_for(std::chrono::microseconds(10));
+            running--;
+        };
+        std::vector<std::thread> callers;
+        for (auto c = 0; c < 3; c++)
+            callers.emplace_back([&] { executor.run(runs.size() / 4, [&](size_t i) { task(i); }); });
+        executor.run(runs.size() / 4, [&](size_t i) { task(i + 3 * runs.size() / 4); });
+        for (auto &t : callers)
+            t.join();
+        CHECK(std::all_of(runs.begin(), runs.begin() + runs.size() / 4, [](auto &r) { return r == 3; }));
+        CHECK(std::all_of(runs.begin() + 3 * runs.size() / 4, runs.end(), [](auto &r) { return r == 1; }));
+        CHECK(max_running <= n_threads);
+
+        /* the nested calls complete even when all the slots are held by the outer tasks */
+        std::atomic<size_t> nested_runs(0);
+        executor.run(2 * n_threads, [&](size_t) {
+            executor.run(8, [&](size_t) { nested_runs++; });
+        });
+        CHECK(nested_runs == 16 * n_threads);
+
+        bool thrown = false;
+        try
+        {
+            executor.run(16, [](size_t i) { if (i == 7) throw std::runtime_error("error"); });
+        }
+        catch (const std::runtime_error &)
+        {
+            thrown = true;
+        }
+        CHECK(thrown);
+
+        /* the constructions split their phases into tasks of the global executor */
+        auto keys = random_keys(300000, uint64_t(1) << 50);
+        grafite::set_build_executor(&executor);
+        grafite::filter<> f(keys.begin(), keys.end(), 16.0);
+        grafite::bucket<> b(keys.begin(), keys.end(), 16.0);
+        grafite::set_build_executor(nullptr);
+        CHECK(count_false_negatives(f, keys, 0) == 0);
+        CHECK(count_false_negatives(b, keys) == 0);
+
+        /*
+         * The reported phases come in order, and both the separate maximum-key scan of a reported construction and the
+         * scan fused with the hashing reject a bpk above the lossless encoding, with and without the executor.
+         */
+        std::vector<grafite::build_phase> phases;
+        grafite::build_options options;
+        options.on_phase_end = [&](const grafite::build_phase phase) { phases.push_back(phase); };
+        grafite::set_build_executor(&executor);
+        grafite::filter<> g(keys.begin(), keys.end(), 16.0, options);
+        grafite::set_build_executor(nullptr);
+        CHECK(count_false_negatives(g, keys, 0) == 0);
+        CHECK((phases == std::vector<grafite::build_phase>{grafite::build_phase::max_key_scan, grafite::build_phase::hashing,
+                                                           grafite::build_phase::sort, grafite::build_phase::encoding}));
+
+        auto small_keys = random_keys(300000, uint64_t(1) << 24);
+        for (auto *e : {(grafite::build_executor *) nullptr, (grafite::build_executor *) &executor})
+            for (auto reported : {false, true})
+            {
+                grafite::set_build_executor(e);
+                bool too_many_bits = false;
+                try
+                {
+                    grafite::filter<> h(small_keys.begin(), small_keys.end(), 24.0, reported ? options : grafite::build_options{});
+                }
+                catch (const std::runtime_error &)
+                {
+                    too_many_bits = true;
+                }
+                grafite::set_build_executor(nullptr);
+                CHECK(too_many_bits);
+            }
+    }
+}
+
+void test_sort()
+{
+    std::vector<uint64_t> empty, single = {42};
+    grafite::radix_sort(empty, uint64_t(0));
+    grafite::radix_sort(single, uint64_t(42));
+    CHECK(empty.empty() && single == std::vector<uint64_t>{42});
+
+    /* the inputs have duplicates, and cover a single digit, several digits and the full 64 bits */
+    for (auto max_value : {uint64_t(200), uint64_t(1) << 33, std::numeric_limits<uint64_t>::max()})
+    {
+        std::mt19937_64 gen(max_value);
+        std::uniform_int_distribution<uint64_t> distr(0, max_value);
+        std::vector<uint64_t> v(1 << 18);
+        std::generate(v.begin(), v.end(), [&] { return distr(gen); });
+        v.back() = max_value;
+        auto expected = v;
+        std::sort(expected.begin(), expected.end());
+
+        auto radix = v;
+        grafite::radix_sort(radix, max_value);
+        CHECK(radix == expected);
+
+        grafite::work_stealing_executor executor(4);
+        auto parallel = v;
+        grafite::parallel_sort(executor, parallel, max_value);
+        CHECK(parallel == expected);
+
+        for (auto backend : {grafite::sort_backend::automatic, grafite::sort_backend::std_sort,
+                             grafite::sort_backend::spreadsort, grafite::sort_backend::parallel_block,
+                             grafite::sort_backend::radix})
+        {
+            grafite::build_options options;
+            options.sort = backend;
+            options.max_threads = 4;
+            auto sorted = v;
+            grafite::sort_keys(sorted, max_value, options);
+            CHECK(sorted == expected);
+        }
+    }
+
+    std::vector<uint64_t> small = {3, 1, 2};
+    grafite::work_stealing_executor executor(2);
+    grafite::parallel_sort(executor, empty, uint64_t(0));
+    grafite::parallel_sort(executor, small, uint64_t(3));
+    CHECK(empty.empty() && small == std::vector<uint64_t>({1, 2, 3}));
+    CHECK(&grafite::shared_sort_executor(3) == &grafite::shared_sort_executor(3));
+}
+
+void test_tuner()
+{
+    using tuner_type = grafite::tuner<grafite::ef_sux_vector, grafite::ef_sux_vector>;
+    std::vector<uint64_t> empty;
+    std::vector<std::pair<uint64_t, uint64_t>> sample;
+    bool thrown = false;
+    try { tuner_type(empty.begin(), empty.end(), sample.begin(), sample.end()); } catch (const std::runtime_error &) { thrown = true; }
+    CHECK(thrown);
+
+    /* without a query sample the tuner still builds and measures both candidates */
+    std::vector<uint64_t> single = {123456789};
+    auto single_res = tuner_type(single.begin(), single.end(), sample.begin(), sample.end()).tune(1024);
+    CHECK(single_res.filter_fpr == 0 && single_res.bucket_fpr == 0 && single_res.trial_builds >= 2);
+
+    /*
+     * The recommended data structure fits the budget if any candidate does, and has the lowest FPR among the ones
+     * that fit. Rebuilt with the recommended bpk, it has the measured size and no false negatives.
+     */
+    auto check_recommended = [](const grafite::tuning_result &res, const std::vector<uint64_t> &keys, const uint64_t budget)
+    {
+        const auto budget_bpk = (double) budget * 8 / keys.size();
+        const auto is_filter = res.kind == grafite::filter_kind::grafite;
+        const auto bpk = is_filter ? res.filter_bpk : res.bucket_bpk, other_bpk = is_filter ? res.bucket_bpk : res.filter_bpk;
+        const auto fpr = res.expected_fpr(), other_fpr = is_filter ? res.bucket_fpr : res.filter_fpr;
+        CHECK(bpk <= budget_bpk || other_bpk > budget_bpk);
+        CHECK(other_bpk > budget_bpk || fpr <= other_fpr);
+        CHECK(fpr >= 0 && fpr <= 1 && other_fpr >= 0 && other_fpr <= 1);
+        if (is_filter)
+        {
+            grafite::filter<grafite::ef_sux_vector> f(keys.begin(), keys.end(), res.bpk);
+            CHECK((double) f.size() * 8 / keys.size() == bpk);
+            CHECK(count_false_negatives(f, keys, 0) == 0);
+        }
+        else
+        {
+            grafite::bucket<grafite::ef_sux_vector> b(keys.begin(), keys.end(), res.bpk);
+            CHECK((double) b.size() * 8 / keys.size() == bpk);
+            CHECK(count_false_negatives(b, keys) == 0);
+        }
+    };
+
+    /* uniform keys and short empty queries */
+    auto keys = random_keys(100000, uint64_t(1) << 40);
+    std::mt19937_64 gen(7);
+    std::uniform_int_distribution<uint64_t> distr(0, uint64_t(1) << 40);
+    for (size_t i = 0; i < 20000; i++)
+    {
+        auto left = distr(gen);
+        sample.emplace_back(left, left + 15);
+    }
+    tuner_type t(keys.begin(), keys.end(), sample.begin(), sample.end());
+    thrown = false;
+    try { (void) t.tune(16); } catch (const std::runtime_error &) { thrown = true; }
+    CHECK(thrown);
+    for (auto budget_bpk : {12, 24, 80})
+    {
+        auto res = t.tune(budget_bpk * keys.size() / 8);
+        CHECK(res.L == 16 && res.trial_builds >= 2 && res.trial_builds <= 2 * t.max_trial_builds);
+        check_recommended(res, keys, budget_bpk * keys.size() / 8);
+    }
+
+    /* on a subsample of a tenth of the keys, the recommended data structure is measured by one build over all of them */
+    t.max_sample_keys = keys.size() / 10;
+    for (auto budget_bpk : {12, 24})
+    {
+        auto res = t.tune(budget_bpk * keys.size() / 8);
+        CHECK(res.confirmed && res.trial_builds <= 2 * t.max_trial_builds);
+        check_recommended(res, keys, budget_bpk * keys.size() / 8);
+    }
+    t.confirm_build = false;
+    CHECK(!t.tune(12 * keys.size() / 8).confirmed);
+    t.confirm_build = true;
+    t.max_sample_keys = size_t(1) << 20;
+
+    /* budgets of at most 2 bits per key leave no room to the grafite::filter, but the grafite::bucket is recommended */
+    for (auto budget_bpk : {0.5, 1.5, 2.0})
+    {
+        const auto budget = (uint64_t) (budget_bpk * keys.size() / 8);
+        auto res = t.tune(budget);
+        CHECK(res.kind == grafite::filter_kind::bucket && std::isinf(res.filter_bpk) && res.filter_fpr == 1);
+        check_recommended(res, keys, budget);
+    }
+
+    /*
+     * Keys clustered in runs of consecutive values and empty queries far from the clusters, which the buckets of the
+     * grafite::bucket never cover.
+     */
+    std::vector<uint64_t> clustered;
+    std::vector<std::pair<uint64_t, uint64_t>> far_sample;
+    for (uint64_t c = 0; c < 1000; c++)
+    {
+        for (uint64_t i = 0; i < 100; i++)
+            clustered.push_back((c << 32) + i);
+        far_sample.emplace_back((c << 32) + (uint64_t(1) << 31), (c << 32) + (uint64_t(1) << 31) + 1000);
+    }
+    const uint64_t budget = 12 * clustered.size() / 8;
+    auto clustered_res = tuner_type(clustered.begin(), clustered.end(), far_sample.begin(), far_sample.end()).tune(budget);
+    CHECK(clustered_res.kind == grafite::filter_kind::bucket && clustered_res.bucket_fpr == 0);
+    check_recommended(clustered_res, clustered, budget);
+
+    /* dense keys, whose lossless encoding takes 2 bits per key, and queries past the last key */
+    std::vector<uint64_t> dense(100000);
+    std::vector<std::pair<uint64_t, uint64_t>> after_sample;
+    std::iota(dense.begin(), dense.end(), uint64_t(0));
+    for (uint64_t i = 0; i < 1000; i++)
+        after_sample.emplace_back(dense.size() + i * 10, dense.size() + i * 10 + 5);
+    const uint64_t dense_budget = 8 * dense.size() / 8;
+    auto dense_res = tuner_type(dense.begin(), dense.end(), after_sample.begin(), after_sample.end()).tune(dense_budget);
+    CHECK(dense_res.kind == grafite::filter_kind::bucket && dense_res.bucket_fpr == 0 && std::isinf(dense_res.filter_bpk));
+    check_recommended(dense_res, dense, dense_budget);
+}
+
+/**
+ * A filter with known answers for the grafite::fpr_monitor: the ranges starting at a multiple of 8 are positive and the
+ * model predicts an FPR of 1/64 for the queries shorter than 16 and of 1/8 for the longer ones.
+ */
+struct scripted_filter
+{
+    bool query(const uint64_t left, const uint64_t) const
+    {
+        return left % 8 == 0;
+    }
+
+    double expected_fpr(const uint64_t length) const
+    {
+        return length < 16 ? 1.0 / 64 : 1.0 / 8;
+    }
+};
+
+void test_fpr_monitor()
+{
+    /*
+     * Each thread queries its own ranges of length 1 and 16. All the positive answers of length 1 are reported, and
+     * half of them are false positives; half of the positive answers of length 16 are reported, and half of the
+     * reported ones are false positives. Thus in both classes the false positives extrapolated to all the positive
+     * answers are a sixteenth of the queries, and the observed FPR is (1/16)/(1 - 1/8 + 1/16) = 1/15, which is above
+     * twice the expected 1/64 of the short queries and below the expected 1/8 of the long ones.
+     */
+    grafite::fpr_monitor<scripted_filter> monitor{scripted_filter()};
+    const uint64_t n_threads = 4, n_queries = 8000;
+    std::vector<std::thread> threads;
+    for (uint64_t t = 0; t < n_threads; t++)
+        threads.emplace_back([&, t] {
+            for (uint64_t left = t * n_queries; left < (t + 1) * n_queries; left++)
+            {
+                if (monitor.query(left))
+                    monitor.report(left, left, left % 16 == 0);
+                if (monitor.query(left, left + 15) && left % 16 == 0)
+                    monitor.report(left, left + 15, left % 32 == 0);
+            }
+        });
+    for (auto &t : threads)
+        t.join();
+
+    auto stats = monitor.stats();
+    const uint64_t queries = n_threads * n_queries, positives = queries / 8;
+    CHECK(stats.size() == 2);
+    CHECK(stats[0].min_length == 1 && stats[0].max_length == 1 && stats[1].min_length == 16 && stats[1].max_length == 31);
+    for (const auto &st : stats)
+    {
+        const auto sampled = st.min_length == 1 ? positives : positives / 2;
+        CHECK(st.queries == queries && st.positives == positives);
+        CHECK(st.sampled == sampled && st.false_positives == sampled / 2);
+        CHECK(std::abs(st.observed_fpr() - 1.0 / 15) < 1e-12);
+    }
+    CHECK(stats[0].expected_fpr == 1.0 / 64 && stats[1].expected_fpr == 1.0 / 8);
+
+    /* the drift of the short queries needs ceil(log2(64/15)) = 3 more bits per key */
+    CHECK(monitor.drifted());
+    CHECK(!monitor.drifted(5.0));
+    CHECK(!monitor.drifted(2.0, positives + 1));
+    CHECK(monitor.suggested_extra_bpk() == 3);
+    CHECK(monitor.suggested_extra_bpk(positives + 1) == 0);
+
+    monitor.reset();
+    CHECK(monitor.stats().empty() && !monitor.drifted() && monitor.suggested_extra_bpk() == 0);
+
+    /* a grafite::filter queried on its keys answers positively, and its model predicts the FPR of its length class */
+    auto keys = random_keys(10000, uint64_t(1) << 40);
+    grafite::fpr_monitor<grafite::filter<>> filter_monitor(grafite::filter<>(keys.begin(), keys.end(), 16.0));
+    for (auto k : keys)
+        CHECK(filter_monitor.query(k));
+    auto filter_stats = filter_monitor.stats();
+    CHECK(filter_stats.size() == 1 && filter_stats[0].queries == keys.size() && filter_stats[0].positives == keys.size());
+    CHECK(std::abs(filter_stats[0].expected_fpr - filter_monitor.filter().expected_fpr(1)) < 1e-6);
+    CHECK(filter_stats[0].observed_fpr() == 0);
+}
+
+int main()
+{
+    test_bucket<false>();
+    test_bucket<true>();
+    test_adaptive_bucket();
+    test_multi_bucket();
+    test_hybrid_filter();
+    test_point_filter<false, grafite::modular_hash<false>>();
+    test_point_filter<true, grafite::modular_hash<true>>();
+    test_point_filter<true, grafite::multiply_shift_hash>();
+    test_point_filter<false, grafite::keyed_hash>();
+    test_static_filter();
+    test_work_stealing_executor();
+    test_sort();
+    test_tuner();
+    test_fpr_monitor();
+    test_filter_hash_policy<grafite::modular_hash<false>>();
+    test_filter_hash_policy<grafite::modular_hash<true>>();
+    test_filter_hash_policy<grafite::multiply_shift_hash>();
+    test_filter_hash_policy<grafite::keyed_hash>();
+
+    if (failures > 0)
+    {
+        std::cerr << "[!] " << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "[+] all tests passed" << std::endl;
+    return 0;
+}